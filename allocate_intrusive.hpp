@@ -0,0 +1,120 @@
+#ifndef ALLOCATE_INTRUSIVE_HPP
+#define ALLOCATE_INTRUSIVE_HPP
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "intrusive_ptr.hpp"
+
+
+namespace std {
+
+    namespace intrusive_detail {
+
+        using deallocate_fn = void (*)(void *object);
+
+        constexpr size_t max_alignment(size_t a, size_t b) {
+            return a > b ? a : b;
+        }
+
+        constexpr size_t round_up(size_t size, size_t alignment) {
+            return (size + alignment - 1) / alignment * alignment;
+        }
+
+        // One allocation holds the allocator, the deallocation function and
+        // the object, in this order. The function pointer sits right in front
+        // of the object so it can be found from the object address alone:
+        //
+        //   [ allocator | padding | deallocate_fn ][ T ]
+        //   ^ block                               ^ block + prefix
+        template <class T, class Alloc>
+        struct allocation_layout {
+            static constexpr size_t alignment =
+                    max_alignment(alignof(T), max_alignment(alignof(Alloc), alignof(deallocate_fn)));
+
+            struct alignas(alignment) unit {
+                unsigned char bytes[alignment];
+            };
+
+            using unit_allocator = typename allocator_traits<Alloc>::template rebind_alloc<unit>;
+            using unit_traits = allocator_traits<unit_allocator>;
+
+            static constexpr size_t prefix = round_up(sizeof(unit_allocator) + sizeof(deallocate_fn), alignment);
+            static constexpr size_t units = (prefix + sizeof(T) + alignment - 1) / alignment;
+
+            static unit_allocator &stored_allocator(unsigned char *block) noexcept {
+                return *reinterpret_cast<unit_allocator *>(block);
+            }
+
+            static void deallocate(void *object) {
+                auto block = static_cast<unsigned char *>(object) - prefix;
+                unit_allocator alloc(std::move(stored_allocator(block)));
+                stored_allocator(block).~unit_allocator();
+                static_cast<T *>(object)->~T();
+                unit_traits::deallocate(alloc, reinterpret_cast<unit *>(block), units);
+            }
+        };
+
+        inline deallocate_fn &stored_deallocate_fn(void *object) noexcept {
+            return *reinterpret_cast<deallocate_fn *>(static_cast<unsigned char *>(object) - sizeof(deallocate_fn));
+        }
+
+    }
+
+    // Destroys an object made by allocate_intrusive and returns its storage
+    // to the allocator it was allocated from.
+    template <class T>
+    inline void intrusive_deallocate(T *ptr) noexcept {
+        intrusive_detail::stored_deallocate_fn(ptr)(ptr);
+    }
+
+    // Base for objects whose storage comes from an allocator. Create them with
+    // allocate_intrusive (or make_intrusive, which uses std::allocator); the
+    // last deref() destroys the object and gives the memory back to the same
+    // allocator, whether that is a per-thread slab, a monotonic arena or a
+    // std::pmr resource.
+    template <class Derived, class CounterPolicy = atomic_ref_count>
+    class allocated_ref_counted : public basic_ref_counted<CounterPolicy, Derived> {
+    public:
+        using intrusive_allocated_type = Derived;
+
+        static void destroy(Derived *ptr) noexcept {
+            intrusive_deallocate(ptr);
+        }
+    };
+
+    template <class T, class Alloc, class... Args>
+    intrusive_ptr<T> allocate_intrusive(const Alloc &alloc, Args &&... args) {
+        static_assert(uses_intrusive_allocator<T>::value,
+                      "T must derive from allocated_ref_counted<T>");
+        static_assert(is_same<typename T::intrusive_allocated_type, T>::value,
+                      "T must be the Derived argument of its allocated_ref_counted base");
+        using layout = intrusive_detail::allocation_layout<T, Alloc>;
+        typename layout::unit_allocator units_alloc(alloc);
+        auto units = layout::unit_traits::allocate(units_alloc, layout::units);
+        auto block = reinterpret_cast<unsigned char *>(std::addressof(*units));
+        T *object;
+        try {
+            object = ::new (static_cast<void *>(block + layout::prefix)) T(std::forward<Args>(args)...);
+        } catch (...) {
+            layout::unit_traits::deallocate(units_alloc, units, layout::units);
+            throw;
+        }
+        ::new (static_cast<void *>(block)) typename layout::unit_allocator(std::move(units_alloc));
+        ::new (static_cast<void *>(&intrusive_detail::stored_deallocate_fn(object)))
+                intrusive_detail::deallocate_fn(&layout::deallocate);
+        return intrusive_ptr<T>(object, false);
+    }
+
+    template <class T, class... Args>
+    inline typename enable_if<uses_intrusive_allocator<T>::value, intrusive_ptr<T>>::type
+    make_intrusive(Args &&... args) {
+        return allocate_intrusive<T>(std::allocator<T>(), std::forward<Args>(args)...);
+    }
+
+}
+
+#endif // ALLOCATE_INTRUSIVE_HPP
@@ -0,0 +1,114 @@
+#ifndef ATOMIC_INTRUSIVE_PTR_HPP
+#define ATOMIC_INTRUSIVE_PTR_HPP
+
+#include <atomic>
+
+#include "hazard_pointer.hpp"
+#include "intrusive_ptr.hpp"
+
+
+namespace std {
+
+    // Shared slot holding an intrusive_ptr.
+    //
+    // The slot owns one ref to its current object. Readers protect the raw
+    // pointer with a hazard pointer before taking their own ref, and writers
+    // hand the slot's old ref to the hazard domain instead of dropping it, so
+    // a reader never increments the count of an object that is being freed.
+    //
+    // No operation takes a lock on the slot itself, but a load may walk the
+    // hazard record registry and allocate a new record, and a store may scan
+    // the hazards and run destructors, so the slot does not report itself
+    // as lock-free.
+    template <class T>
+    class atomic_intrusive_ptr {
+    public:
+        using value_type = intrusive_ptr<T>;
+
+        constexpr atomic_intrusive_ptr() noexcept : ptr_(nullptr) {}
+
+        atomic_intrusive_ptr(intrusive_ptr<T> desired) noexcept : ptr_(desired.detach()) {}
+
+        atomic_intrusive_ptr(const atomic_intrusive_ptr &) = delete;
+
+        atomic_intrusive_ptr &operator=(const atomic_intrusive_ptr &) = delete;
+
+        ~atomic_intrusive_ptr() {
+            retire(ptr_.load(std::memory_order_relaxed));
+        }
+
+        static constexpr bool is_always_lock_free = false;
+
+        bool is_lock_free() const noexcept {
+            return false;
+        }
+
+        intrusive_ptr<T> load() const {
+            hazard_guard guard;
+            auto ptr = guard.protect(ptr_);
+            return intrusive_ptr<T>(ptr);
+        }
+
+        operator intrusive_ptr<T>() const {
+            return load();
+        }
+
+        void store(intrusive_ptr<T> desired) {
+            retire(ptr_.exchange(desired.detach()));
+        }
+
+        atomic_intrusive_ptr &operator=(intrusive_ptr<T> desired) {
+            store(std::move(desired));
+            return *this;
+        }
+
+        intrusive_ptr<T> exchange(intrusive_ptr<T> desired) {
+            auto old = ptr_.exchange(desired.detach());
+            // readers may still be about to take a ref through the slot's one
+            intrusive_ptr<T> result(old);
+            retire(old);
+            return result;
+        }
+
+        bool compare_exchange_strong(intrusive_ptr<T> &expected, intrusive_ptr<T> desired) {
+            auto old = expected.get();
+            if (ptr_.compare_exchange_strong(old, desired.get())) {
+                desired.detach();
+                retire(old);
+                return true;
+            }
+            expected = load();
+            return false;
+        }
+
+        bool compare_exchange_weak(intrusive_ptr<T> &expected, intrusive_ptr<T> desired) {
+            auto old = expected.get();
+            if (ptr_.compare_exchange_weak(old, desired.get())) {
+                desired.detach();
+                retire(old);
+                return true;
+            }
+            expected = load();
+            return false;
+        }
+
+    private:
+        static void release(void *ptr) {
+            intrusive_ptr_release(static_cast<T *>(ptr));
+        }
+
+        static void retire(T *ptr) {
+            if (ptr) {
+                hazard_retire(ptr, &release);
+            }
+        }
+
+        std::atomic<T *> ptr_;
+    };
+
+    template <class T>
+    constexpr bool atomic_intrusive_ptr<T>::is_always_lock_free;
+
+}
+
+#endif // ATOMIC_INTRUSIVE_PTR_HPP
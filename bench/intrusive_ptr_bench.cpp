@@ -0,0 +1,375 @@
+// Hot paths of intrusive_ptr against std::shared_ptr and, when Boost is
+// available, boost::intrusive_ptr.
+//
+//   cmake -S . -B build && cmake --build build --target bench_json
+//
+// or run intrusive_ptr_bench directly with the usual --benchmark_* flags.
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#if INTRUSIVE_PTR_BENCH_BOOST
+#include <boost/smart_ptr/intrusive_ptr.hpp>
+#include <boost/smart_ptr/intrusive_ref_counter.hpp>
+#endif
+
+#include "intrusive_ptr.hpp"
+#include "intrusive_vector.hpp"
+#include "numa_allocator.hpp"
+#include "weak_intrusive_ptr.hpp"
+
+namespace {
+
+    constexpr size_t container_size = 1024;
+
+    struct intrusive_object : std::ref_counted_base<intrusive_object> {
+        int payload = 0;
+    };
+
+    struct local_object : std::ref_counted_base<local_object, std::plain_ref_count> {
+        int payload = 0;
+    };
+
+    struct weak_object : std::weak_ref_counted {
+        int payload = 0;
+    };
+
+    struct shared_object {
+        int payload = 0;
+    };
+
+    struct placed_object : std::allocated_ref_counted<placed_object> {
+        int payload = 0;
+    };
+
+    struct replicated_object : std::numa_ref_counted<replicated_object> {
+        int payload = 0;
+    };
+
+    // One factory per pointer kind; benchmarks are templated on these.
+    struct intrusive_kind {
+        using pointer = std::intrusive_ptr<intrusive_object>;
+
+        static pointer make() {
+            return std::make_intrusive<intrusive_object>();
+        }
+    };
+
+    struct local_kind {
+        using pointer = std::intrusive_ptr<local_object>;
+
+        static pointer make() {
+            return std::make_intrusive<local_object>();
+        }
+    };
+
+    struct shared_kind {
+        using pointer = std::shared_ptr<shared_object>;
+
+        static pointer make() {
+            return std::make_shared<shared_object>();
+        }
+    };
+
+    // One rc_ in memory bound to node 0.
+    struct numa_placed_kind {
+        using pointer = std::intrusive_ptr<placed_object>;
+
+        static pointer make() {
+            return std::make_intrusive<placed_object>(std::numa_node(0));
+        }
+    };
+
+    // One counter replica per node.
+    struct numa_replica_kind {
+        using pointer = std::intrusive_ptr<replicated_object>;
+
+        static pointer make() {
+            return std::make_intrusive<replicated_object>();
+        }
+    };
+
+#if INTRUSIVE_PTR_BENCH_BOOST
+    struct boost_object : boost::intrusive_ref_counter<boost_object, boost::thread_safe_counter> {
+        int payload = 0;
+    };
+
+    struct boost_kind {
+        using pointer = boost::intrusive_ptr<boost_object>;
+
+        static pointer make() {
+            return pointer(new boost_object);
+        }
+    };
+#endif
+
+    template <class Kind>
+    void copy_destroy(benchmark::State &state) {
+        auto ptr = Kind::make();
+        for (auto _ : state) {
+            auto copy = ptr;
+            benchmark::DoNotOptimize(copy);
+        }
+    }
+
+    template <class Kind>
+    void move(benchmark::State &state) {
+        auto ptr = Kind::make();
+        for (auto _ : state) {
+            auto moved = std::move(ptr);
+            benchmark::DoNotOptimize(moved);
+            ptr = std::move(moved);
+        }
+    }
+
+    template <class Kind>
+    void create_destroy(benchmark::State &state) {
+        for (auto _ : state) {
+            auto ptr = Kind::make();
+            benchmark::DoNotOptimize(ptr);
+        }
+    }
+
+    // Every thread copies and drops refs to one object shared by all of
+    // them, so the counter cache line bounces between cores.
+    template <class Kind>
+    void contended_copy_destroy(benchmark::State &state) {
+        static auto shared = Kind::make();
+        auto ptr = shared;
+        for (auto _ : state) {
+            auto copy = ptr;
+            benchmark::DoNotOptimize(copy);
+        }
+    }
+
+    // Pins benchmark thread i of n to CPU i * cpus / n, so that larger
+    // thread counts spread over every socket instead of filling node 0.
+    // Thread 0 is the main thread, so the old affinity is restored on scope
+    // exit to keep later benchmarks unpinned.
+    class spread_pin {
+    public:
+        explicit spread_pin(const benchmark::State &state) noexcept {
+#if defined(__linux__)
+            auto cpus = static_cast<int>(std::thread::hardware_concurrency());
+            saved_ = cpus > 0 && pthread_getaffinity_np(pthread_self(), sizeof(previous_), &previous_) == 0;
+            if (saved_) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(state.thread_index() * cpus / state.threads(), &set);
+                pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            }
+#else
+            (void) state;
+#endif
+        }
+
+        ~spread_pin() {
+#if defined(__linux__)
+            if (saved_) {
+                pthread_setaffinity_np(pthread_self(), sizeof(previous_), &previous_);
+            }
+#endif
+        }
+
+        spread_pin(const spread_pin &) = delete;
+
+        spread_pin &operator=(const spread_pin &) = delete;
+
+    private:
+#if defined(__linux__)
+        cpu_set_t previous_;
+        bool saved_;
+#endif
+    };
+
+    // contended_copy_destroy with the threads spread across sockets: the
+    // scaling curve of one shared counter against per-node replicas.
+    template <class Kind>
+    void cross_node_copy_destroy(benchmark::State &state) {
+        static auto shared = Kind::make();
+        spread_pin pin(state);
+        auto ptr = shared;
+        for (auto _ : state) {
+            auto copy = ptr;
+            benchmark::DoNotOptimize(copy);
+        }
+    }
+
+    void intrusive_weak_lock(benchmark::State &state) {
+        std::intrusive_ptr<weak_object> strong(new weak_object, false);
+        std::weak_intrusive_ptr<weak_object> weak(strong.get());
+        for (auto _ : state) {
+            auto locked = weak.lock();
+            benchmark::DoNotOptimize(locked);
+        }
+    }
+
+    void shared_weak_lock(benchmark::State &state) {
+        auto strong = std::make_shared<shared_object>();
+        std::weak_ptr<shared_object> weak(strong);
+        for (auto _ : state) {
+            auto locked = weak.lock();
+            benchmark::DoNotOptimize(locked);
+        }
+    }
+
+    template <class Kind>
+    std::vector<typename Kind::pointer> distinct_objects() {
+        std::vector<typename Kind::pointer> objects;
+        objects.reserve(container_size);
+        for (size_t i = 0; i < container_size; ++i) {
+            objects.push_back(Kind::make());
+        }
+        return objects;
+    }
+
+    // push_back without reserve: measures reallocation traffic.
+    template <class Kind>
+    void vector_grow(benchmark::State &state) {
+        auto objects = distinct_objects<Kind>();
+        for (auto _ : state) {
+            std::vector<typename Kind::pointer> grown;
+            for (auto &ptr : objects) {
+                grown.push_back(ptr);
+            }
+            benchmark::DoNotOptimize(grown.data());
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * container_size));
+    }
+
+    void intrusive_vector_grow(benchmark::State &state) {
+        auto objects = distinct_objects<intrusive_kind>();
+        for (auto _ : state) {
+            std::intrusive_vector<intrusive_object> grown;
+            for (auto &ptr : objects) {
+                grown.push_back(ptr);
+            }
+            benchmark::DoNotOptimize(grown.data());
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * container_size));
+    }
+
+    template <class Kind>
+    void vector_sort(benchmark::State &state) {
+        auto objects = distinct_objects<Kind>();
+        for (auto _ : state) {
+            state.PauseTiming();
+            auto shuffled = objects;
+            std::reverse(shuffled.begin(), shuffled.end());
+            state.ResumeTiming();
+            std::sort(shuffled.begin(), shuffled.end(), [](const typename Kind::pointer &a,
+                                                           const typename Kind::pointer &b) {
+                return a.get() < b.get();
+            });
+            benchmark::DoNotOptimize(shuffled.data());
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * container_size));
+    }
+
+    void intrusive_vector_sort(benchmark::State &state) {
+        auto objects = distinct_objects<intrusive_kind>();
+        for (auto _ : state) {
+            state.PauseTiming();
+            std::intrusive_vector<intrusive_object> shuffled;
+            for (auto it = objects.rbegin(); it != objects.rend(); ++it) {
+                shuffled.push_back(*it);
+            }
+            state.ResumeTiming();
+            shuffled.sort();
+            benchmark::DoNotOptimize(shuffled.data());
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * container_size));
+    }
+
+    // Dropping many refs to the same few objects, one by one or grouped.
+    void fan_out_release(benchmark::State &state) {
+        auto ptr = intrusive_kind::make();
+        for (auto _ : state) {
+            state.PauseTiming();
+            std::vector<intrusive_kind::pointer> copies(container_size, ptr);
+            state.ResumeTiming();
+            copies.clear();
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * container_size));
+    }
+
+    void fan_out_batch_release(benchmark::State &state) {
+        auto ptr = intrusive_kind::make();
+        for (auto _ : state) {
+            state.PauseTiming();
+            std::vector<intrusive_kind::pointer> copies(container_size, ptr);
+            state.ResumeTiming();
+            std::batch_release(copies.begin(), copies.end());
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * container_size));
+    }
+
+    int max_threads() {
+        auto threads = static_cast<int>(std::thread::hardware_concurrency());
+        return threads > 0 ? threads : 1;
+    }
+
+}
+
+BENCHMARK_TEMPLATE(copy_destroy, intrusive_kind);
+BENCHMARK_TEMPLATE(copy_destroy, local_kind);
+BENCHMARK_TEMPLATE(copy_destroy, shared_kind);
+
+BENCHMARK_TEMPLATE(move, intrusive_kind);
+BENCHMARK_TEMPLATE(move, shared_kind);
+
+BENCHMARK_TEMPLATE(create_destroy, intrusive_kind);
+BENCHMARK_TEMPLATE(create_destroy, shared_kind);
+
+BENCHMARK_TEMPLATE(contended_copy_destroy, intrusive_kind)->ThreadRange(1, max_threads())->UseRealTime();
+BENCHMARK_TEMPLATE(contended_copy_destroy, shared_kind)->ThreadRange(1, max_threads())->UseRealTime();
+
+BENCHMARK_TEMPLATE(cross_node_copy_destroy, intrusive_kind)->ThreadRange(1, max_threads())->UseRealTime();
+BENCHMARK_TEMPLATE(cross_node_copy_destroy, numa_placed_kind)->ThreadRange(1, max_threads())->UseRealTime();
+BENCHMARK_TEMPLATE(cross_node_copy_destroy, numa_replica_kind)->ThreadRange(1, max_threads())->UseRealTime();
+
+BENCHMARK(intrusive_weak_lock);
+BENCHMARK(shared_weak_lock);
+
+BENCHMARK_TEMPLATE(vector_grow, intrusive_kind);
+BENCHMARK_TEMPLATE(vector_grow, shared_kind);
+BENCHMARK(intrusive_vector_grow);
+
+BENCHMARK_TEMPLATE(vector_sort, intrusive_kind);
+BENCHMARK_TEMPLATE(vector_sort, shared_kind);
+BENCHMARK(intrusive_vector_sort);
+
+BENCHMARK(fan_out_release);
+BENCHMARK(fan_out_batch_release);
+
+#if INTRUSIVE_PTR_BENCH_BOOST
+BENCHMARK_TEMPLATE(copy_destroy, boost_kind);
+BENCHMARK_TEMPLATE(move, boost_kind);
+BENCHMARK_TEMPLATE(create_destroy, boost_kind);
+BENCHMARK_TEMPLATE(contended_copy_destroy, boost_kind)->ThreadRange(1, max_threads())->UseRealTime();
+BENCHMARK_TEMPLATE(vector_grow, boost_kind);
+BENCHMARK_TEMPLATE(vector_sort, boost_kind);
+#endif
+
+int main(int argc, char **argv) {
+    // libstdc++ skips the shared_ptr atomics until a second thread has been
+    // started; start one so every pointer kind pays for real atomics.
+    std::thread([] {}).join();
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
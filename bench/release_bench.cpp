@@ -0,0 +1,100 @@
+// Cycles per intrusive_ptr destruction under contention, before and after
+// the single-RMW release path.
+//
+//   cmake --build build --target release_bench
+//   build/release_bench [threads] [iterations]
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include <chrono>
+
+#include "../intrusive_ptr.hpp"
+
+namespace {
+
+    inline unsigned long long cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    // The previous release path: a seq_cst unique() check followed by an
+    // acq_rel fetch_sub.
+    class legacy_ref_count {
+    public:
+        explicit legacy_ref_count(size_t initial) noexcept : rc_(initial) {}
+
+        inline void bind(void *, void (*)(void *)) noexcept {}
+
+        inline void increment(size_t n = 1) noexcept {
+            rc_.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        inline bool decrement(size_t n = 1) noexcept {
+            if (rc_ == n) {
+                return true;
+            }
+            return rc_.fetch_sub(n, std::memory_order_acq_rel) == n;
+        }
+
+        inline size_t load() const noexcept {
+            return rc_;
+        }
+
+    private:
+        std::atomic<size_t> rc_;
+    };
+
+    struct current_object : std::ref_counted_base<current_object> {};
+
+    struct legacy_object : std::ref_counted_base<legacy_object, legacy_ref_count> {};
+
+    template <class T>
+    double cycles_per_release(unsigned threads, unsigned iterations) {
+        std::intrusive_ptr<T> shared(new T, false);
+        std::atomic<unsigned> ready{0};
+        std::atomic<unsigned long long> total{0};
+        std::vector<std::thread> workers;
+        for (unsigned i = 0; i < threads; ++i) {
+            workers.emplace_back([&] {
+                std::vector<std::intrusive_ptr<T>> copies(iterations, shared);
+                ready.fetch_add(1);
+                while (ready.load() != threads) {
+                    // spin until every thread holds its copies
+                }
+                auto start = cycles();
+                copies.clear();
+                total.fetch_add(cycles() - start);
+            });
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        return static_cast<double>(total.load()) / (static_cast<double>(threads) * iterations);
+    }
+
+}
+
+int main(int argc, char **argv) {
+    unsigned max_threads = argc > 1 ? static_cast<unsigned>(std::atoi(argv[1])) : std::thread::hardware_concurrency();
+    unsigned iterations = argc > 2 ? static_cast<unsigned>(std::atoi(argv[2])) : 1000000;
+    if (max_threads == 0) {
+        max_threads = 1;
+    }
+    std::printf("%8s %12s %12s\n", "threads", "legacy", "current");
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+        auto legacy = cycles_per_release<legacy_object>(threads, iterations);
+        auto current = cycles_per_release<current_object>(threads, iterations);
+        std::printf("%8u %12.2f %12.2f\n", threads, legacy, current);
+    }
+    return 0;
+}
@@ -0,0 +1,38 @@
+// Nanoseconds per intrusive_task spawned and awaited: frame allocation from
+// the slab heaps, the continuation handshake and the frame release.
+//
+//   cmake --build build --target task_bench
+//   build/task_bench [tasks]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "../intrusive_task.hpp"
+
+namespace {
+
+    std::intrusive_task<long> leaf(long value) {
+        co_return value;
+    }
+
+    std::intrusive_task<long> sum(long count) {
+        long total = 0;
+        for (long i = 0; i < count; ++i) {
+            total += co_await leaf(i);
+        }
+        co_return total;
+    }
+
+}
+
+int main(int argc, char **argv) {
+    long count = argc > 1 ? std::atol(argv[1]) : 1000000;
+    auto start = std::chrono::steady_clock::now();
+    auto task = sum(count);
+    task.start();
+    auto total = task.result();
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%ld tasks, %.2f ns per task (sum %ld)\n", count, count ? elapsed / count : 0.0, total);
+    return total == count * (count - 1) / 2 ? 0 : 1;
+}
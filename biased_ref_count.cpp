@@ -0,0 +1,194 @@
+#include "biased_ref_count.hpp"
+
+#include <mutex>
+#include <thread>
+
+namespace std {
+
+    namespace {
+
+        std::mutex &thread_state_pool_mutex() {
+            static std::mutex mtx;
+            return mtx;
+        }
+
+        biased_thread_state *&thread_state_pool() {
+            static biased_thread_state *head = nullptr;
+            return head;
+        }
+
+        // set once the thread-local attachment of this thread is destroyed
+        thread_local bool thread_exiting = false;
+
+    }
+
+    constexpr intptr_t biased_ref_count::merged_flag;
+    constexpr intptr_t biased_ref_count::queued_flag;
+    constexpr intptr_t biased_ref_count::flag_mask;
+    constexpr intptr_t biased_ref_count::count_one;
+
+    biased_ref_count::biased_ref_count(size_t initial) noexcept
+            : owner_(current_thread_state()), local_(initial), shared_(0) {
+        if (owner_.load(std::memory_order_relaxed) == exiting_thread_state()) {
+            owner_.store(nullptr, std::memory_order_relaxed);
+            local_.store(0, std::memory_order_relaxed);
+            shared_.store(static_cast<intptr_t>(initial) * count_one | merged_flag, std::memory_order_relaxed);
+        }
+    }
+
+    biased_thread_state *biased_ref_count::exiting_thread_state() noexcept {
+        static biased_thread_state state;
+        return &state;
+    }
+
+    biased_thread_state *biased_ref_count::attach_thread() noexcept {
+        struct attachment {
+            biased_thread_state *state = nullptr;
+
+            ~attachment() {
+                if (!state) {
+                    return;
+                }
+                drain(state);
+                tls_state() = nullptr;
+                thread_exiting = true;
+                {
+                    std::lock_guard<std::mutex> guard(thread_state_pool_mutex());
+                    state->next_free = thread_state_pool();
+                    state->parked.store(true, std::memory_order_relaxed);
+                    thread_state_pool() = state;
+                }
+                // objects queued since the drain above; pairs with the
+                // fence in decrement_shared()
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                drain_parked(state);
+            }
+        };
+
+        if (thread_exiting) {
+            return exiting_thread_state();
+        }
+        static thread_local attachment current;
+        {
+            std::lock_guard<std::mutex> guard(thread_state_pool_mutex());
+            current.state = thread_state_pool();
+            if (current.state) {
+                thread_state_pool() = current.state->next_free;
+                current.state->next_free = nullptr;
+                current.state->parked.store(false, std::memory_order_relaxed);
+            }
+        }
+        if (current.state) {
+            // merges other threads started on the parked record own its
+            // objects until they finish
+            while (current.state->drainers.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+        }
+        if (!current.state) {
+            current.state = new biased_thread_state;
+        }
+        tls_state() = current.state;
+        // an adopted record may still hold objects queued to its old thread
+        drain(current.state);
+        return current.state;
+    }
+
+    void biased_ref_count::drain(biased_thread_state *state) noexcept {
+        auto entry = state->merge_queue.exchange(nullptr, std::memory_order_acquire);
+        while (entry) {
+            while (entry) {
+                auto next = entry->next_queued_;
+                entry->merge_queued();
+                entry = next;
+            }
+            entry = state->merge_queue.exchange(nullptr, std::memory_order_acquire);
+        }
+    }
+
+    void biased_ref_count::drain_parked(biased_thread_state *state) noexcept {
+        {
+            std::lock_guard<std::mutex> guard(thread_state_pool_mutex());
+            if (!state->parked.load(std::memory_order_relaxed)) {
+                return;
+            }
+            state->drainers.fetch_add(1, std::memory_order_relaxed);
+        }
+        drain(state);
+        state->drainers.fetch_sub(1, std::memory_order_release);
+    }
+
+    bool biased_ref_count::merge_local() noexcept {
+        auto value = shared_.load(std::memory_order_relaxed);
+        while (!shared_.compare_exchange_weak(value, value | merged_flag,
+                                              std::memory_order_acq_rel,
+                                              std::memory_order_relaxed)) {
+            // retry
+        }
+        auto owner = owner_.load(std::memory_order_relaxed);
+        // publish the merge before giving up ownership, see decrement_shared()
+        owner_.store(nullptr, std::memory_order_release);
+        if ((value & queued_flag) != 0) {
+            // this object sits in our own queue; draining it now settles the
+            // count (and may destroy it) without waiting for the next flush
+            drain(owner);
+            return false;
+        }
+        return count_of(value) == 0;
+    }
+
+    bool biased_ref_count::decrement_shared(intptr_t n) noexcept {
+        // Read the owner first: if it is already gone, the merge it did is
+        // visible to the CAS below and the object is never queued.
+        auto owner = owner_.load(std::memory_order_acquire);
+        auto value = shared_.load(std::memory_order_relaxed);
+        intptr_t next;
+        bool enqueue;
+        do {
+            next = value - n * count_one;
+            enqueue = (value & (merged_flag | queued_flag)) == 0 && count_of(next) < 0;
+            if (enqueue) {
+                next |= queued_flag;
+            }
+        } while (!shared_.compare_exchange_weak(value, next,
+                                                std::memory_order_acq_rel,
+                                                std::memory_order_relaxed));
+        if (enqueue) {
+            next_queued_ = owner->merge_queue.load(std::memory_order_relaxed);
+            while (!owner->merge_queue.compare_exchange_weak(next_queued_, this,
+                                                             std::memory_order_release,
+                                                             std::memory_order_relaxed)) {
+                // retry
+            }
+            // an exited owner will not drain its queue; pairs with the
+            // fence in the thread-exit path of attach_thread()
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (owner->parked.load(std::memory_order_relaxed)) {
+                drain_parked(owner);
+            }
+            return false;
+        }
+        return (next & merged_flag) != 0 && (next & queued_flag) == 0 && count_of(next) == 0;
+    }
+
+    void biased_ref_count::merge_queued() noexcept {
+        auto local = static_cast<intptr_t>(local_.load(std::memory_order_relaxed));
+        local_.store(0, std::memory_order_relaxed);
+        auto value = shared_.load(std::memory_order_relaxed);
+        intptr_t next;
+        do {
+            next = ((value + local * count_one) & ~queued_flag) | merged_flag;
+        } while (!shared_.compare_exchange_weak(value, next,
+                                                std::memory_order_acq_rel,
+                                                std::memory_order_relaxed));
+        owner_.store(nullptr, std::memory_order_release);
+        if (count_of(next) == 0) {
+            reclaim_(object_);
+        }
+    }
+
+    void flush_biased_merges() noexcept {
+        biased_ref_count::drain(biased_ref_count::current_thread_state());
+    }
+
+} //
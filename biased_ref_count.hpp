@@ -0,0 +1,136 @@
+#ifndef BIASED_REF_COUNT_HPP
+#define BIASED_REF_COUNT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "ref_counted.hpp"
+
+
+namespace std {
+
+    class biased_ref_count;
+
+    // Merges the counters of every object that other threads queued to the
+    // calling thread, destroying the ones whose total count reached zero.
+    // Call it from quiescent points of long-running owner threads.
+    void flush_biased_merges() noexcept;
+
+    // Per-thread owner record. Records are never freed: when a thread exits,
+    // its record goes to a pool and is adopted by the next new thread, which
+    // then owns every object the old thread still had local refs to. While a
+    // record sits in the pool, a thread that queues an object to it merges
+    // the queue itself, so nothing waits for a thread that may never come.
+    struct biased_thread_state {
+        std::atomic<biased_ref_count *> merge_queue{nullptr};
+        biased_thread_state *next_free = nullptr;
+        std::atomic<bool> parked{false};
+        // threads merging the queue of the parked record
+        std::atomic<size_t> drainers{0};
+    };
+
+    // Biased reference counting: the owning thread counts in a non-atomic
+    // local counter, other threads count in a shared atomic counter. The
+    // shared counter may go negative while the owner still holds local refs;
+    // the first time it does, the object is queued to its owner, which merges
+    // both counters on its next decrement of that object, its next
+    // flush_biased_merges(), or at thread exit. After a merge every operation
+    // uses the shared counter.
+    class biased_ref_count {
+    public:
+        explicit biased_ref_count(size_t initial) noexcept;
+
+        inline void bind(void *object, void (*reclaim)(void *)) noexcept {
+            object_ = object;
+            reclaim_ = reclaim;
+        }
+
+        inline void increment(size_t n = 1) noexcept {
+            if (owner_.load(std::memory_order_relaxed) == current_thread_state()) {
+                local_.store(local_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+            } else {
+                shared_.fetch_add(static_cast<intptr_t>(n) * count_one, std::memory_order_relaxed);
+            }
+        }
+
+        inline bool decrement(size_t n = 1) noexcept {
+            if (owner_.load(std::memory_order_relaxed) == current_thread_state()) {
+                auto local = local_.load(std::memory_order_relaxed);
+                if (n >= local) {
+                    // refs past the local ones were counted by other threads
+                    local_.store(0, std::memory_order_relaxed);
+                    if (n > local) {
+                        shared_.fetch_sub(static_cast<intptr_t>(n - local) * count_one, std::memory_order_relaxed);
+                    }
+                    return merge_local();
+                }
+                local_.store(local - n, std::memory_order_relaxed);
+                if ((shared_.load(std::memory_order_relaxed) & queued_flag) != 0) {
+                    // other threads released refs we counted locally
+                    flush_biased_merges();
+                }
+                return false;
+            }
+            return decrement_shared(static_cast<intptr_t>(n));
+        }
+
+        // Exact on the owning thread and after the counters were merged,
+        // a snapshot otherwise.
+        inline size_t load() const noexcept {
+            return static_cast<size_t>(static_cast<intptr_t>(local_.load(std::memory_order_relaxed)) +
+                                       count_of(shared_.load(std::memory_order_acquire)));
+        }
+
+        // Owner record of the calling thread. Threads that are past their
+        // thread-local destructors get a shared record that never owns
+        // anything, so their objects start out merged.
+        static inline biased_thread_state *current_thread_state() noexcept {
+            auto state = tls_state();
+            return state ? state : attach_thread();
+        }
+
+    private:
+        friend void flush_biased_merges() noexcept;
+
+        static constexpr intptr_t merged_flag = 1;
+        static constexpr intptr_t queued_flag = 2;
+        static constexpr intptr_t flag_mask = merged_flag | queued_flag;
+        static constexpr intptr_t count_one = 4;
+
+        static inline intptr_t count_of(intptr_t value) noexcept {
+            return (value & ~flag_mask) / count_one;
+        }
+
+        static inline biased_thread_state *&tls_state() noexcept {
+            static thread_local biased_thread_state *state = nullptr;
+            return state;
+        }
+
+        static biased_thread_state *attach_thread() noexcept;
+
+        static biased_thread_state *exiting_thread_state() noexcept;
+
+        static void drain(biased_thread_state *state) noexcept;
+
+        static void drain_parked(biased_thread_state *state) noexcept;
+
+        bool merge_local() noexcept;
+
+        bool decrement_shared(intptr_t n) noexcept;
+
+        void merge_queued() noexcept;
+
+        std::atomic<biased_thread_state *> owner_;
+        std::atomic<size_t> local_;
+        std::atomic<intptr_t> shared_;
+        biased_ref_count *next_queued_ = nullptr;
+        void *object_ = nullptr;
+        void (*reclaim_)(void *) = nullptr;
+    };
+
+    using biased_ref_counted = basic_ref_counted<biased_ref_count>;
+
+}
+
+#endif // BIASED_REF_COUNT_HPP
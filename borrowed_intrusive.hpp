@@ -0,0 +1,140 @@
+#ifndef BORROWED_INTRUSIVE_HPP
+#define BORROWED_INTRUSIVE_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+
+#include "intrusive_ptr.hpp"
+
+
+namespace std {
+
+    // Non-owning view of an object kept alive by some intrusive_ptr further
+    // up the stack. Meant for parameters: it converts implicitly from
+    // intrusive_ptr, is a trivially copyable raw pointer passed in a
+    // register, and never touches the count. Taking ownership is explicit
+    // through add_ref().
+    //
+    // The caller guarantees that a reference outlives the view, as with
+    // string_view: binding a temporary intrusive_ptr is fine for a call
+    // argument, not for a local. Debug builds assert that the referent still
+    // has a non-zero count whenever the view is dereferenced.
+    template <class T>
+    class borrowed_intrusive {
+    public:
+        using element_type = T;
+
+        using pointer = T*;
+
+        constexpr borrowed_intrusive() noexcept : ptr_(nullptr) {
+            // nop
+        }
+
+        constexpr borrowed_intrusive(std::nullptr_t) noexcept : ptr_(nullptr) {
+            // nop
+        }
+
+        explicit borrowed_intrusive(pointer raw_ptr) noexcept : ptr_(raw_ptr) {
+            // nop
+        }
+
+        template <class Y>
+        borrowed_intrusive(const intrusive_ptr<Y>& other) noexcept : ptr_(other.get()) {
+            static_assert(std::is_convertible<Y*, T*>::value, "Y* is not assignable to T*");
+        }
+
+        template <class Y>
+        borrowed_intrusive(borrowed_intrusive<Y> other) noexcept : ptr_(other.get()) {
+            static_assert(std::is_convertible<Y*, T*>::value, "Y* is not assignable to T*");
+        }
+
+        inline pointer get() const noexcept {
+            check();
+            return ptr_;
+        }
+
+        inline pointer operator->() const noexcept {
+            check();
+            return ptr_;
+        }
+
+        inline T& operator*() const noexcept {
+            check();
+            return *ptr_;
+        }
+
+        inline explicit operator bool() const noexcept {
+            return ptr_ != nullptr;
+        }
+
+        inline bool operator!() const noexcept {
+            return ptr_ == nullptr;
+        }
+
+        // Promotes the view to an owning pointer; the only count update.
+        inline intrusive_ptr<T> add_ref() const noexcept {
+            check();
+            return intrusive_ptr<T>(ptr_, borrow_ref);
+        }
+
+    private:
+        inline void check() const noexcept {
+            assert((!ptr_ || ptr_->get_reference_count() > 0) && "borrowed_intrusive outlived its referent");
+        }
+
+        pointer ptr_;
+    };
+
+    template <class T, class U>
+    inline bool operator==(borrowed_intrusive<T> a, borrowed_intrusive<U> b) noexcept {
+        return a.get() == b.get();
+    }
+
+    template <class T, class U>
+    inline bool operator!=(borrowed_intrusive<T> a, borrowed_intrusive<U> b) noexcept {
+        return a.get() != b.get();
+    }
+
+    template <class T, class U>
+    inline bool operator<(borrowed_intrusive<T> a, borrowed_intrusive<U> b) noexcept {
+        using pointer = typename common_type<T*, U*>::type;
+        return std::less<pointer>()(a.get(), b.get());
+    }
+
+    template <class T>
+    inline bool operator==(borrowed_intrusive<T> a, std::nullptr_t) noexcept {
+        return !a;
+    }
+
+    template <class T>
+    inline bool operator==(std::nullptr_t, borrowed_intrusive<T> b) noexcept {
+        return !b;
+    }
+
+    template <class T>
+    inline bool operator!=(borrowed_intrusive<T> a, std::nullptr_t) noexcept {
+        return static_cast<bool>(a);
+    }
+
+    template <class T>
+    inline bool operator!=(std::nullptr_t, borrowed_intrusive<T> b) noexcept {
+        return static_cast<bool>(b);
+    }
+
+    template <class T>
+    inline T* get_pointer(borrowed_intrusive<T> p) noexcept {
+        return p.get();
+    }
+
+    template <class T>
+    struct hash<borrowed_intrusive<T>> {
+        inline size_t operator()(borrowed_intrusive<T> p) const noexcept {
+            return hash<T*>()(p.get());
+        }
+    };
+
+}
+
+#endif // BORROWED_INTRUSIVE_HPP
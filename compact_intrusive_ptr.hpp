@@ -0,0 +1,369 @@
+#ifndef COMPACT_INTRUSIVE_PTR_HPP
+#define COMPACT_INTRUSIVE_PTR_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <utility>
+
+#include "intrusive_ptr.hpp"
+#include "ref_counted.hpp"
+
+
+namespace std {
+
+    template <class T>
+    class intrusive_pool;
+
+    // ref_counted_base for objects that live in intrusive_pool<Derived> and
+    // are referenced by compact_intrusive_ptr. The default 32-bit counter
+    // plus the pool index make an 8-byte header.
+    template <class Derived, class CounterPolicy = atomic_ref_count32>
+    class pooled_ref_counted : public basic_ref_counted<CounterPolicy, Derived> {
+    public:
+        inline uint32_t pool_index() const noexcept {
+            return pool_index_;
+        }
+
+        static void destroy(Derived *ptr) noexcept {
+            intrusive_pool<Derived>::instance().destroy(ptr);
+        }
+
+    private:
+        friend class intrusive_pool<Derived>;
+
+        uint32_t pool_index_ = 0;
+    };
+
+    // Per-type object pool addressed by 32-bit indices; index 0 is null.
+    //
+    // Slots are grouped in chunks that double in size, so the chunk table
+    // has a fixed length, chunks never move and index lookup takes no lock.
+    // Each thread caches up to cache_size free indices, so creation and
+    // destruction take the pool mutex only once per cache_batch slots, to
+    // refill the cache or hand half of a full one back. Freed slots are
+    // reused before the pool grows. Chunks are never returned to the system.
+    template <class T>
+    class intrusive_pool {
+    public:
+        static intrusive_pool &instance() noexcept {
+            static intrusive_pool pool;
+            return pool;
+        }
+
+        template <class... Args>
+        uint32_t create(Args &&... args) {
+            auto index = allocate_slot();
+            T *object;
+            try {
+                object = ::new (static_cast<void *>(slot_of(index))) T(std::forward<Args>(args)...);
+            } catch (...) {
+                free_slot(index);
+                throw;
+            }
+            object->pool_index_ = index;
+            return index;
+        }
+
+        void destroy(T *ptr) noexcept {
+            auto index = ptr->pool_index();
+            ptr->~T();
+            free_slot(index);
+        }
+
+        inline T *get(uint32_t index) const noexcept {
+            return index ? static_cast<T *>(static_cast<void *>(slot_of(index))) : nullptr;
+        }
+
+    private:
+        union slot {
+            alignas(T) unsigned char storage[sizeof(T)];
+            uint32_t next_free;
+        };
+
+        // Chunk c holds 1 << (first_chunk_shift + c) slots, except the last,
+        // which stops at the largest index.
+        static constexpr unsigned first_chunk_shift = 10;
+        static constexpr unsigned max_chunks = 33 - first_chunk_shift;
+        static constexpr uint64_t last_position = uint64_t{UINT32_MAX - 1} + (uint64_t{1} << first_chunk_shift);
+
+        static constexpr uint32_t cache_size = 64;
+        static constexpr uint32_t cache_batch = cache_size / 2;
+
+        struct thread_cache {
+            uint32_t slots[cache_size];
+            uint32_t count = 0;
+            // slots freed by later thread-local destructors skip the cache
+            bool exited = false;
+
+            ~thread_cache() {
+                instance().release_cache(*this);
+            }
+        };
+
+        static thread_cache &local_cache() noexcept {
+            static thread_local thread_cache cache;
+            return cache;
+        }
+
+        intrusive_pool() noexcept {
+            for (auto &chunk : chunks_) {
+                chunk.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        static inline unsigned floor_log2(uint64_t value) noexcept {
+#if defined(__GNUC__)
+            return 63 - static_cast<unsigned>(__builtin_clzll(value));
+#else
+            unsigned result = 0;
+            while (value >>= 1) {
+                ++result;
+            }
+            return result;
+#endif
+        }
+
+        inline slot *slot_of(uint32_t index) const noexcept {
+            auto position = uint64_t{index - 1} + (uint64_t{1} << first_chunk_shift);
+            auto chunk = floor_log2(position) - first_chunk_shift;
+            auto offset = position - (uint64_t{1} << (chunk + first_chunk_shift));
+            return chunks_[chunk].load(std::memory_order_acquire) + offset;
+        }
+
+        uint32_t allocate_slot() {
+            auto &cache = local_cache();
+            if (cache.count) {
+                return cache.slots[--cache.count];
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto index = take_locked();
+            if (!cache.exited) {
+                try {
+                    while (cache.count < cache_batch - 1) {
+                        cache.slots[cache.count++] = take_locked();
+                    }
+                } catch (...) {
+                    // out of slots or memory; keep what was taken
+                }
+            }
+            return index;
+        }
+
+        void free_slot(uint32_t index) noexcept {
+            auto &cache = local_cache();
+            if (!cache.exited && cache.count < cache_size) {
+                cache.slots[cache.count++] = index;
+                return;
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            push_locked(index);
+            while (cache.count > cache_batch) {
+                push_locked(cache.slots[--cache.count]);
+            }
+        }
+
+        void release_cache(thread_cache &cache) noexcept {
+            std::lock_guard<std::mutex> lock(mutex_);
+            while (cache.count) {
+                push_locked(cache.slots[--cache.count]);
+            }
+            cache.exited = true;
+        }
+
+        uint32_t take_locked() {
+            if (free_) {
+                auto index = free_;
+                free_ = slot_of(index)->next_free;
+                return index;
+            }
+            if (next_ == UINT32_MAX) {
+                throw std::bad_alloc();
+            }
+            auto position = uint64_t{next_} + (uint64_t{1} << first_chunk_shift);
+            auto chunk = floor_log2(position) - first_chunk_shift;
+            if (!chunks_[chunk].load(std::memory_order_relaxed)) {
+                auto first = uint64_t{1} << (chunk + first_chunk_shift);
+                auto slots = first <= last_position - first ? first : last_position - first + 1;
+                chunks_[chunk].store(static_cast<slot *>(::operator new(static_cast<size_t>(slots) * sizeof(slot))),
+                                     std::memory_order_release);
+            }
+            return ++next_;
+        }
+
+        inline void push_locked(uint32_t index) noexcept {
+            slot_of(index)->next_free = free_;
+            free_ = index;
+        }
+
+        std::atomic<slot *> chunks_[max_chunks];
+        std::mutex mutex_;
+        uint32_t free_ = 0;
+        uint32_t next_ = 0;
+    };
+
+    template <class T>
+    constexpr unsigned intrusive_pool<T>::first_chunk_shift;
+
+    template <class T>
+    constexpr unsigned intrusive_pool<T>::max_chunks;
+
+    template <class T>
+    constexpr uint64_t intrusive_pool<T>::last_position;
+
+    template <class T>
+    constexpr uint32_t intrusive_pool<T>::cache_size;
+
+    template <class T>
+    constexpr uint32_t intrusive_pool<T>::cache_batch;
+
+    // intrusive_ptr that stores a 32-bit intrusive_pool<T> index instead of
+    // a pointer. T derives from pooled_ref_counted<T>; every dereference
+    // costs one chunk table lookup.
+    template <class T>
+    class compact_intrusive_ptr {
+    public:
+        using pointer = T*;
+        using element_type = T;
+        using reference = T&;
+        using index_type = uint32_t;
+
+        constexpr compact_intrusive_ptr() noexcept : index_(0) {}
+
+        constexpr compact_intrusive_ptr(std::nullptr_t) noexcept : index_(0) {}
+
+        compact_intrusive_ptr(pointer raw_ptr, bool add_ref = true) noexcept
+                : index_(raw_ptr ? raw_ptr->pool_index() : 0) {
+            if (raw_ptr && add_ref) {
+                intrusive_ptr_add_ref(raw_ptr);
+            }
+        }
+
+        compact_intrusive_ptr(const intrusive_ptr<T> &ptr) noexcept : compact_intrusive_ptr(ptr.get()) {}
+
+        compact_intrusive_ptr(compact_intrusive_ptr &&other) noexcept : index_(other.index_) {
+            other.index_ = 0;
+        }
+
+        compact_intrusive_ptr(const compact_intrusive_ptr &other) noexcept : index_(other.index_) {
+            if (index_) {
+                intrusive_ptr_add_ref(get());
+            }
+        }
+
+        compact_intrusive_ptr &operator=(compact_intrusive_ptr other) noexcept {
+            swap(other);
+            return *this;
+        }
+
+        ~compact_intrusive_ptr() {
+            if (index_) {
+                intrusive_ptr_release(get());
+            }
+        }
+
+        // Adopts one ref to the object at index.
+        static compact_intrusive_ptr adopt(index_type index) noexcept {
+            compact_intrusive_ptr result;
+            result.index_ = index;
+            return result;
+        }
+
+        index_type detach() noexcept {
+            auto result = index_;
+            index_ = 0;
+            return result;
+        }
+
+        void reset() noexcept {
+            compact_intrusive_ptr().swap(*this);
+        }
+
+        index_type index() const noexcept {
+            return index_;
+        }
+
+        pointer get() const noexcept {
+            return intrusive_pool<T>::instance().get(index_);
+        }
+
+        intrusive_ptr<T> to_intrusive() const noexcept {
+            return intrusive_ptr<T>(get());
+        }
+
+        pointer operator->() const noexcept {
+            return get();
+        }
+
+        reference operator*() const {
+            return *get();
+        }
+
+        explicit operator bool() const noexcept {
+            return index_ != 0;
+        }
+
+        void swap(compact_intrusive_ptr &other) noexcept {
+            std::swap(index_, other.index_);
+        }
+
+    private:
+        index_type index_;
+    };
+
+    template <class T>
+    struct trivially_relocatable<compact_intrusive_ptr<T>> : true_type {};
+
+    template <class T, class... Args>
+    inline compact_intrusive_ptr<T> make_compact_intrusive(Args &&... args) {
+        return compact_intrusive_ptr<T>::adopt(intrusive_pool<T>::instance().create(std::forward<Args>(args)...));
+    }
+
+    template <class T>
+    bool operator==(compact_intrusive_ptr<T> const &a, compact_intrusive_ptr<T> const &b) noexcept {
+        return a.index() == b.index();
+    }
+
+    template <class T>
+    bool operator!=(compact_intrusive_ptr<T> const &a, compact_intrusive_ptr<T> const &b) noexcept {
+        return a.index() != b.index();
+    }
+
+    template <class T>
+    bool operator<(compact_intrusive_ptr<T> const &a, compact_intrusive_ptr<T> const &b) noexcept {
+        return a.index() < b.index();
+    }
+
+    template <class T>
+    bool operator==(compact_intrusive_ptr<T> const &x, std::nullptr_t) noexcept {
+        return !x;
+    }
+
+    template <class T>
+    bool operator!=(compact_intrusive_ptr<T> const &x, std::nullptr_t) noexcept {
+        return static_cast<bool>(x);
+    }
+
+    template <class T>
+    inline void swap(compact_intrusive_ptr<T> &a, compact_intrusive_ptr<T> &b) noexcept {
+        a.swap(b);
+    }
+
+    template <class T>
+    T *get_pointer(compact_intrusive_ptr<T> const &p) noexcept {
+        return p.get();
+    }
+
+    template <typename T>
+    struct hash<compact_intrusive_ptr<T>> {
+        size_t operator()(const compact_intrusive_ptr<T> &ptr) const noexcept {
+            return std::hash<uint32_t>()(ptr.index());
+        }
+    };
+
+}
+
+#endif // COMPACT_INTRUSIVE_PTR_HPP
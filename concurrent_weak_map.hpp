@@ -0,0 +1,323 @@
+#ifndef CONCURRENT_WEAK_MAP_HPP
+#define CONCURRENT_WEAK_MAP_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "epoch_reclaim.hpp"
+#include "intrusive_ptr.hpp"
+#include "weak_intrusive_ptr.hpp"
+
+
+namespace std {
+
+    // Sharded hash map from Key to weak_intrusive_ptr<T>, for interning
+    // caches: the map never keeps a value alive, and find() hands out a
+    // strong ref only while someone else still holds one. T derives from
+    // weak_ref_counted.
+    //
+    // Readers take no lock: they walk the bucket chains inside an
+    // epoch_guard and upgrade the weak ref with lock(). Writers lock one
+    // shard, publish fully built nodes with a release store, and retire
+    // unlinked nodes and outgrown bucket arrays through epoch reclamation.
+    //
+    // Entries whose value expired are dropped without a sweep: a lookup that
+    // hits one erases it if the shard lock is free, writers purge expired
+    // entries of every bucket they touch, and growing a shard copies only
+    // live entries.
+    template <class Key, class T, class Hash = std::hash<Key>, class KeyEqual = std::equal_to<Key>,
+              size_t Shards = 16>
+    class concurrent_weak_map {
+    public:
+        static_assert(Shards > 0, "at least one shard is required");
+
+        using key_type = Key;
+        using mapped_type = weak_intrusive_ptr<T>;
+
+        explicit concurrent_weak_map(size_t buckets_per_shard = 16, const Hash &hash = Hash(),
+                                     const KeyEqual &equal = KeyEqual())
+                : hash_(hash), equal_(equal) {
+            for (auto &s : shards_) {
+                s.buckets.store(new table(buckets_per_shard), std::memory_order_relaxed);
+            }
+        }
+
+        concurrent_weak_map(const concurrent_weak_map &) = delete;
+
+        concurrent_weak_map &operator=(const concurrent_weak_map &) = delete;
+
+        // Concurrent readers must be gone; retired nodes are left to the
+        // epoch reclaimer.
+        ~concurrent_weak_map() {
+            for (auto &s : shards_) {
+                delete_table(s.buckets.load(std::memory_order_relaxed));
+            }
+        }
+
+        // Strong ref to the live value stored under key, or null.
+        intrusive_ptr<T> find(const Key &key) const {
+            auto h = hash_(key);
+            auto &s = shard_of(h);
+            bool expired = false;
+            intrusive_ptr<T> result;
+            {
+                epoch_guard guard;
+                auto buckets = s.buckets.load(std::memory_order_acquire);
+                for (auto n = buckets->bucket(h).load(std::memory_order_acquire); n;
+                     n = n->next.load(std::memory_order_acquire)) {
+                    if (n->hash == h && equal_(n->key, key)) {
+                        result = n->value.lock();
+                        expired = !result;
+                        break;
+                    }
+                }
+            }
+            if (expired) {
+                bool retired = false;
+                {
+                    std::unique_lock<std::mutex> lock(s.mtx, std::try_to_lock);
+                    if (lock.owns_lock()) {
+                        retired = purge_bucket(s, h);
+                    }
+                }
+                if (retired) {
+                    epoch_reclaim();
+                }
+            }
+            return result;
+        }
+
+        // Returns the live value under key, or stores and returns make(),
+        // which must produce an intrusive_ptr<T>. make() runs under the
+        // shard lock, so one key is never created twice concurrently.
+        template <class Factory>
+        intrusive_ptr<T> find_or_insert(const Key &key, Factory &&make) {
+            if (auto found = find(key)) {
+                return found;
+            }
+            auto h = hash_(key);
+            auto &s = shard_of(h);
+            intrusive_ptr<T> value;
+            bool retired;
+            {
+                std::lock_guard<std::mutex> lock(s.mtx);
+                retired = purge_bucket(s, h);
+                if (auto n = lookup_locked(s, h, key)) {
+                    value = n->value.lock();
+                }
+                if (!value) {
+                    value = make();
+                    retired |= link(s, h, key, value.get());
+                }
+            }
+            if (retired) {
+                epoch_reclaim();
+            }
+            return value;
+        }
+
+        // Stores value under key unless a live value is already there;
+        // returns whether value was stored.
+        bool insert(const Key &key, const intrusive_ptr<T> &value) {
+            auto h = hash_(key);
+            auto &s = shard_of(h);
+            bool stored = false;
+            bool retired;
+            {
+                std::lock_guard<std::mutex> lock(s.mtx);
+                retired = purge_bucket(s, h);
+                if (!lookup_locked(s, h, key)) {
+                    retired |= link(s, h, key, value.get());
+                    stored = true;
+                }
+            }
+            if (retired) {
+                epoch_reclaim();
+            }
+            return stored;
+        }
+
+        bool erase(const Key &key) {
+            auto h = hash_(key);
+            auto &s = shard_of(h);
+            size_t removed;
+            bool retired;
+            {
+                std::lock_guard<std::mutex> lock(s.mtx);
+                retired = purge_bucket(s, h);
+                removed = unlink_if(s, h, [&](const node &n) { return n.hash == h && equal_(n.key, key); });
+            }
+            if (retired || removed) {
+                epoch_reclaim();
+            }
+            return removed != 0;
+        }
+
+        // Number of stored entries, expired ones not yet dropped included.
+        size_t size() const noexcept {
+            size_t total = 0;
+            for (auto &s : shards_) {
+                total += s.count.load(std::memory_order_relaxed);
+            }
+            return total;
+        }
+
+    private:
+        struct node {
+            node(size_t h, const Key &k, T *v) : hash(h), key(k), value(v), next(nullptr) {}
+
+            const size_t hash;
+            const Key key;
+            const weak_intrusive_ptr<T> value;
+            std::atomic<node *> next;
+        };
+
+        struct table {
+            explicit table(size_t size) : mask(round_up(size) - 1), heads(new std::atomic<node *>[mask + 1]) {
+                for (size_t i = 0; i <= mask; ++i) {
+                    heads[i].store(nullptr, std::memory_order_relaxed);
+                }
+            }
+
+            // The low bits of the hash pick the shard.
+            inline std::atomic<node *> &bucket(size_t h) const noexcept {
+                return heads[(h / Shards) & mask];
+            }
+
+            static inline size_t round_up(size_t size) noexcept {
+                size_t result = 1;
+                while (result < size) {
+                    result <<= 1;
+                }
+                return result;
+            }
+
+            const size_t mask;
+            std::unique_ptr<std::atomic<node *>[]> heads;
+        };
+
+        struct shard {
+            std::mutex mtx;
+            std::atomic<table *> buckets;
+            std::atomic<size_t> count{0};
+            char padding[64];
+        };
+
+        static void delete_node(void *ptr) {
+            delete static_cast<node *>(ptr);
+        }
+
+        // Frees a table and every node still linked into it.
+        static void delete_table(void *ptr) {
+            auto buckets = static_cast<table *>(ptr);
+            for (size_t i = 0; i <= buckets->mask; ++i) {
+                auto n = buckets->heads[i].load(std::memory_order_relaxed);
+                while (n) {
+                    auto next = n->next.load(std::memory_order_relaxed);
+                    delete n;
+                    n = next;
+                }
+            }
+            delete buckets;
+        }
+
+        inline shard &shard_of(size_t h) const noexcept {
+            return const_cast<shard &>(shards_[h % Shards]);
+        }
+
+        node *lookup_locked(shard &s, size_t h, const Key &key) const {
+            auto buckets = s.buckets.load(std::memory_order_relaxed);
+            for (auto n = buckets->bucket(h).load(std::memory_order_relaxed); n;
+                 n = n->next.load(std::memory_order_relaxed)) {
+                if (n->hash == h && equal_(n->key, key)) {
+                    return n;
+                }
+            }
+            return nullptr;
+        }
+
+        // Unlinks and retires every node of the bucket of h that matches.
+        //
+        // Helpers called under the shard lock only retire. epoch_reclaim()
+        // drains the thread's whole limbo list and may run destructors of
+        // any retired object, including a T that erases its own key, so the
+        // public members call it after unlocking.
+        template <class Predicate>
+        size_t unlink_if(shard &s, size_t h, Predicate matches) const {
+            size_t removed = 0;
+            auto prev = &s.buckets.load(std::memory_order_relaxed)->bucket(h);
+            auto n = prev->load(std::memory_order_relaxed);
+            while (n) {
+                auto next = n->next.load(std::memory_order_relaxed);
+                if (matches(*n)) {
+                    prev->store(next, std::memory_order_release);
+                    epoch_retire(n, &delete_node);
+                    ++removed;
+                } else {
+                    prev = &n->next;
+                }
+                n = next;
+            }
+            if (removed) {
+                s.count.fetch_sub(removed, std::memory_order_relaxed);
+            }
+            return removed;
+        }
+
+        // Returns whether anything was retired.
+        bool purge_bucket(shard &s, size_t h) const {
+            return unlink_if(s, h, [](const node &n) { return n.value->expired(); }) != 0;
+        }
+
+        // Returns whether the shard grew, which retires its old table.
+        bool link(shard &s, size_t h, const Key &key, T *value) {
+            auto buckets = s.buckets.load(std::memory_order_relaxed);
+            bool grew = false;
+            if (s.count.load(std::memory_order_relaxed) > buckets->mask) {
+                buckets = grow(s, buckets);
+                grew = true;
+            }
+            auto n = new node(h, key, value);
+            auto &head = buckets->bucket(h);
+            n->next.store(head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            head.store(n, std::memory_order_release);
+            s.count.fetch_add(1, std::memory_order_relaxed);
+            return grew;
+        }
+
+        // Readers may still walk the old chains, so live entries are copied
+        // into fresh nodes rather than relinked.
+        table *grow(shard &s, table *old) {
+            std::unique_ptr<table> bigger(new table((old->mask + 1) * 2));
+            size_t live = 0;
+            for (size_t i = 0; i <= old->mask; ++i) {
+                for (auto n = old->heads[i].load(std::memory_order_relaxed); n;
+                     n = n->next.load(std::memory_order_relaxed)) {
+                    if (n->value->expired()) {
+                        continue;
+                    }
+                    auto copy = new node(n->hash, n->key, n->value.get());
+                    auto &head = bigger->bucket(n->hash);
+                    copy->next.store(head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                    head.store(copy, std::memory_order_relaxed);
+                    ++live;
+                }
+            }
+            s.buckets.store(bigger.get(), std::memory_order_release);
+            s.count.store(live, std::memory_order_relaxed);
+            epoch_retire(old, &delete_table);
+            return bigger.release();
+        }
+
+        shard shards_[Shards];
+        Hash hash_;
+        KeyEqual equal_;
+    };
+
+}
+
+#endif // CONCURRENT_WEAK_MAP_HPP
@@ -0,0 +1,129 @@
+#ifndef COW_PTR_HPP
+#define COW_PTR_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <utility>
+
+#include "intrusive_ptr.hpp"
+
+
+namespace std {
+
+    // Copy-on-write handle to a ref counted T. Copies share the object and
+    // only give const access; mutate() clones it through T's copy
+    // constructor (make_intrusive, so allocate_intrusive types keep their
+    // allocator) unless this handle holds the only ref.
+    //
+    // unique() loads the count with acquire ordering, so when it reports a
+    // single ref, every read made through refs other threads have since
+    // dropped happens before the caller's writes. New refs must come only
+    // from copying a handle: a weak_intrusive_ptr that upgrades, or a raw
+    // pointer re-wrapped, while mutate() runs defeats the check.
+    //
+    // The reference returned by mutate() is invalidated by the next copy of
+    // this handle; finish editing before sharing the object again.
+    template <class T>
+    class cow_ptr {
+    public:
+        using element_type = T;
+
+        cow_ptr() noexcept = default;
+
+        cow_ptr(std::nullptr_t) noexcept {
+            // nop
+        }
+
+        explicit cow_ptr(intrusive_ptr<T> ptr) noexcept : ptr_(std::move(ptr)) {
+            // nop
+        }
+
+        inline const T *get() const noexcept {
+            return ptr_.get();
+        }
+
+        inline const T &operator*() const noexcept {
+            return *ptr_;
+        }
+
+        inline const T *operator->() const noexcept {
+            return ptr_.get();
+        }
+
+        inline explicit operator bool() const noexcept {
+            return static_cast<bool>(ptr_);
+        }
+
+        inline bool unique() const noexcept {
+            return ptr_ && ptr_->unique();
+        }
+
+        // Write access; clones first if the object is shared.
+        T &mutate() {
+            assert(ptr_ && "mutate() on an empty cow_ptr");
+            if (!ptr_->unique()) {
+                ptr_ = make_intrusive<T>(static_cast<const T &>(*ptr_));
+            }
+            return *ptr_;
+        }
+
+        // Calls f(T&) once after a single uniqueness check, for edits that
+        // touch several fields, and returns what f returns.
+        template <class F>
+        auto mutate_many(F &&f) -> decltype(std::forward<F>(f)(std::declval<T &>())) {
+            return std::forward<F>(f)(mutate());
+        }
+
+        inline void reset() noexcept {
+            ptr_.reset();
+        }
+
+        inline void swap(cow_ptr &other) noexcept {
+            ptr_.swap(other.ptr_);
+        }
+
+    private:
+        intrusive_ptr<T> ptr_;
+    };
+
+    template <class T, class... Args>
+    inline cow_ptr<T> make_cow(Args &&... args) {
+        return cow_ptr<T>(make_intrusive<T>(std::forward<Args>(args)...));
+    }
+
+    template <class T>
+    inline bool operator==(const cow_ptr<T> &a, const cow_ptr<T> &b) noexcept {
+        return a.get() == b.get();
+    }
+
+    template <class T>
+    inline bool operator!=(const cow_ptr<T> &a, const cow_ptr<T> &b) noexcept {
+        return a.get() != b.get();
+    }
+
+    template <class T>
+    inline bool operator==(const cow_ptr<T> &a, std::nullptr_t) noexcept {
+        return !a;
+    }
+
+    template <class T>
+    inline bool operator!=(const cow_ptr<T> &a, std::nullptr_t) noexcept {
+        return static_cast<bool>(a);
+    }
+
+    template <class T>
+    inline void swap(cow_ptr<T> &a, cow_ptr<T> &b) noexcept {
+        a.swap(b);
+    }
+
+    template <class T>
+    struct hash<cow_ptr<T>> {
+        inline size_t operator()(const cow_ptr<T> &p) const noexcept {
+            return hash<const T *>()(p.get());
+        }
+    };
+
+}
+
+#endif // COW_PTR_HPP
@@ -0,0 +1,268 @@
+#include "cycle_collector.hpp"
+
+#include <vector>
+
+namespace std {
+
+    constexpr uint8_t cycle_collected::color_black;
+    constexpr uint8_t cycle_collected::color_purple;
+    constexpr uint8_t cycle_collected::color_gray;
+    constexpr uint8_t cycle_collected::color_white;
+    constexpr uint8_t cycle_collected::color_freed;
+    constexpr size_t cycle_collected::not_buffered;
+
+    namespace {
+
+        struct root_buffer {
+            std::vector<cycle_collected *> roots;
+            bool collecting = false;
+            bool exited = false;
+
+            ~root_buffer();
+        };
+
+        root_buffer &thread_roots() noexcept {
+            static thread_local root_buffer buffer;
+            return buffer;
+        }
+
+    }
+
+    namespace intrusive_detail {
+
+        struct cycle_collector {
+            using stack = std::vector<cycle_collected *>;
+
+            static void unbuffer(root_buffer &buffer, cycle_collected *obj) noexcept {
+                auto last = buffer.roots.back();
+                buffer.roots[obj->root_index_] = last;
+                last->root_index_ = obj->root_index_;
+                buffer.roots.pop_back();
+                obj->root_index_ = cycle_collected::not_buffered;
+            }
+
+            static void forget_roots(root_buffer &buffer) noexcept {
+                for (auto obj : buffer.roots) {
+                    obj->root_index_ = cycle_collected::not_buffered;
+                }
+                buffer.roots.clear();
+            }
+
+            // Subtracts every edge inside the subgraph reachable from root.
+            static void mark_gray(cycle_collected *root, stack &pending) {
+                if (root->color_ == cycle_collected::color_gray) {
+                    return;
+                }
+                root->color_ = cycle_collected::color_gray;
+                pending.push_back(root);
+                cycle_visitor visit([](cycle_collected *child, void *context) {
+                    --child->rc_;
+                    if (child->color_ != cycle_collected::color_gray) {
+                        child->color_ = cycle_collected::color_gray;
+                        static_cast<stack *>(context)->push_back(child);
+                    }
+                    return false;
+                }, &pending);
+                while (!pending.empty()) {
+                    auto obj = pending.back();
+                    pending.pop_back();
+                    obj->visit_children(visit);
+                }
+            }
+
+            // Restores the edges of everything reachable from an object that
+            // is still referenced from outside.
+            static void scan_black(cycle_collected *root, stack &pending) {
+                root->color_ = cycle_collected::color_black;
+                pending.push_back(root);
+                cycle_visitor visit([](cycle_collected *child, void *context) {
+                    ++child->rc_;
+                    if (child->color_ != cycle_collected::color_black) {
+                        child->color_ = cycle_collected::color_black;
+                        static_cast<stack *>(context)->push_back(child);
+                    }
+                    return false;
+                }, &pending);
+                while (!pending.empty()) {
+                    auto obj = pending.back();
+                    pending.pop_back();
+                    obj->visit_children(visit);
+                }
+            }
+
+            static void scan(cycle_collected *root, stack &pending, stack &restore) {
+                pending.push_back(root);
+                cycle_visitor visit([](cycle_collected *child, void *context) {
+                    static_cast<stack *>(context)->push_back(child);
+                    return false;
+                }, &pending);
+                while (!pending.empty()) {
+                    auto obj = pending.back();
+                    pending.pop_back();
+                    if (obj->color_ != cycle_collected::color_gray) {
+                        continue;
+                    }
+                    if (obj->rc_ > 0) {
+                        scan_black(obj, restore);
+                    } else {
+                        obj->color_ = cycle_collected::color_white;
+                        obj->visit_children(visit);
+                    }
+                }
+            }
+
+            static void collect_white(root_buffer &buffer, cycle_collected *root, stack &pending, stack &garbage) {
+                if (root->color_ != cycle_collected::color_white) {
+                    return;
+                }
+                struct context {
+                    root_buffer &buffer;
+                    stack &pending;
+                    stack &garbage;
+                } ctx{buffer, pending, garbage};
+                auto take = [](cycle_collected *obj, void *context_ptr) {
+                    auto &c = *static_cast<context *>(context_ptr);
+                    if (obj->color_ != cycle_collected::color_white) {
+                        return false;
+                    }
+                    // a root outside this slice that turned out to be garbage
+                    if (obj->root_index_ != cycle_collected::not_buffered) {
+                        unbuffer(c.buffer, obj);
+                    }
+                    obj->color_ = cycle_collected::color_freed;
+                    c.garbage.push_back(obj);
+                    c.pending.push_back(obj);
+                    return false;
+                };
+                cycle_visitor visit(take, &ctx);
+                take(root, &ctx);
+                while (!pending.empty()) {
+                    auto obj = pending.back();
+                    pending.pop_back();
+                    obj->visit_children(visit);
+                }
+            }
+
+            static size_t collect_slice(root_buffer &buffer, size_t slice_roots) {
+                stack batch;
+                while (!buffer.roots.empty() && batch.size() < slice_roots) {
+                    auto obj = buffer.roots.back();
+                    buffer.roots.pop_back();
+                    obj->root_index_ = cycle_collected::not_buffered;
+                    // a ref() since buffering made it black: it's in use
+                    if (obj->color_ == cycle_collected::color_purple) {
+                        batch.push_back(obj);
+                    }
+                }
+                stack pending;
+                stack restore;
+                for (auto obj : batch) {
+                    mark_gray(obj, pending);
+                }
+                for (auto obj : batch) {
+                    scan(obj, pending, restore);
+                }
+                stack garbage;
+                for (auto obj : batch) {
+                    collect_white(buffer, obj, pending, garbage);
+                }
+                // Edges from garbage to survivors were subtracted by
+                // mark_gray; put them back so the destructors can drop them
+                // normally. Edges between garbage objects are detached, so no
+                // destructor touches an object deleted before it.
+                cycle_visitor restore_edge([](cycle_collected *child, void *) {
+                    if (child->color_ == cycle_collected::color_freed) {
+                        return true;
+                    }
+                    ++child->rc_;
+                    return false;
+                }, nullptr);
+                for (auto obj : garbage) {
+                    obj->visit_children(restore_edge);
+                }
+                for (auto obj : garbage) {
+                    delete obj;
+                }
+                return garbage.size();
+            }
+        };
+
+    }
+
+    namespace {
+
+        root_buffer::~root_buffer() {
+            collect_all_cycles();
+            intrusive_detail::cycle_collector::forget_roots(*this);
+            // roots of later thread-local destructors are not buffered
+            exited = true;
+        }
+
+    }
+
+    cycle_collected::~cycle_collected() {
+        // nop
+    }
+
+    cycle_collected::cycle_collected() noexcept : rc_(1), root_index_(not_buffered), color_(color_black) {
+        // nop
+    }
+
+    cycle_collected::cycle_collected(const cycle_collected &) noexcept
+            : rc_(1), root_index_(not_buffered), color_(color_black) {
+        // nop; don't copy reference count
+    }
+
+    cycle_collected &cycle_collected::operator=(const cycle_collected &) noexcept {
+        // nop; intentionally don't copy reference count
+        return *this;
+    }
+
+    void cycle_collected::release() noexcept {
+        if (root_index_ != not_buffered) {
+            intrusive_detail::cycle_collector::unbuffer(thread_roots(), this);
+        }
+        delete this;
+    }
+
+    void cycle_collected::possible_root() noexcept {
+        color_ = color_purple;
+        if (root_index_ != not_buffered) {
+            return;
+        }
+        auto &buffer = thread_roots();
+        if (buffer.exited) {
+            return;
+        }
+        try {
+            buffer.roots.push_back(this);
+            root_index_ = buffer.roots.size() - 1;
+        } catch (...) {
+            // out of memory; a cycle through this object may leak
+        }
+    }
+
+    size_t collect_cycles(std::chrono::steady_clock::duration budget, size_t slice_roots) noexcept {
+        auto &buffer = thread_roots();
+        if (buffer.collecting || buffer.roots.empty()) {
+            return 0;
+        }
+        buffer.collecting = true;
+        auto start = std::chrono::steady_clock::now();
+        size_t freed = 0;
+        do {
+            freed += intrusive_detail::cycle_collector::collect_slice(buffer, slice_roots ? slice_roots : 1);
+        } while (!buffer.roots.empty() && std::chrono::steady_clock::now() - start < budget);
+        buffer.collecting = false;
+        return freed;
+    }
+
+    size_t collect_all_cycles() noexcept {
+        return collect_cycles(std::chrono::steady_clock::duration::max());
+    }
+
+    size_t pending_cycle_roots() noexcept {
+        return thread_roots().roots.size();
+    }
+
+} //
@@ -0,0 +1,147 @@
+#ifndef CYCLE_COLLECTOR_HPP
+#define CYCLE_COLLECTOR_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "intrusive_ptr.hpp"
+
+
+namespace std {
+
+    class cycle_collected;
+
+    namespace intrusive_detail {
+
+        struct cycle_collector;
+
+    }
+
+    // Passed to cycle_collected::visit_children; call it once per owning
+    // pointer the object holds. When the owner is garbage the collector may
+    // detach the pointer, which is why it is taken by non-const reference.
+    class cycle_visitor {
+    public:
+        // fn returns true to have the visited pointer detached
+        cycle_visitor(bool (*fn)(cycle_collected *, void *), void *context) noexcept
+                : fn_(fn), context_(context) {
+            // nop
+        }
+
+        template <class T>
+        inline void operator()(intrusive_ptr<T> &child) noexcept {
+            if (child && fn_(child.get(), context_)) {
+                child.detach();
+            }
+        }
+
+    private:
+        bool (*fn_)(cycle_collected *, void *);
+        void *context_;
+    };
+
+    // Reference counted base whose cycles are reclaimed by trial deletion
+    // (Bacon and Rajan, "Concurrent Cycle Collection in Reference Counted
+    // Systems", synchronous variant).
+    //
+    // A deref() that leaves the count above zero buffers the object as a
+    // possible cycle root. collect_cycles() later subtracts the refs that
+    // come from inside the subgraph reachable from a batch of roots; objects
+    // left at zero are only referenced by each other and are destroyed.
+    //
+    // Objects must be confined to one thread, as with local_ref_counted: the
+    // counts are plain integers and the root buffer belongs to the calling
+    // thread. visit_children() must report every intrusive_ptr to another
+    // cycle_collected the object owns; a missed edge makes its target look
+    // externally referenced, which only keeps the cycle alive. Before garbage
+    // is deleted, its pointers to other garbage are detached, so destructors
+    // only release objects that survive the collection.
+    class cycle_collected {
+    public:
+        virtual ~cycle_collected();
+
+        cycle_collected() noexcept;
+
+        cycle_collected(const cycle_collected &) noexcept;
+
+        cycle_collected &operator=(const cycle_collected &) noexcept;
+
+        inline void ref(size_t n = 1) noexcept {
+            rc_ += n;
+            color_ = color_black;
+        }
+
+        inline void deref(size_t n = 1) noexcept {
+            rc_ -= n;
+            if (rc_ == 0) {
+                release();
+            } else if (color_ != color_purple) {
+                possible_root();
+            }
+        }
+
+        inline bool unique() const noexcept {
+            return rc_ == 1;
+        }
+
+        inline size_t get_reference_count() const noexcept {
+            return rc_;
+        }
+
+    protected:
+        virtual void visit_children(cycle_visitor &visit) noexcept = 0;
+
+    private:
+        friend struct intrusive_detail::cycle_collector;
+
+        void release() noexcept;
+
+        void possible_root() noexcept;
+
+        static constexpr uint8_t color_black = 0;  // in use
+        static constexpr uint8_t color_purple = 1; // possible root
+        static constexpr uint8_t color_gray = 2;   // trial deleted
+        static constexpr uint8_t color_white = 3;  // garbage
+        static constexpr uint8_t color_freed = 4;  // about to be destroyed
+        static constexpr size_t not_buffered = static_cast<size_t>(-1);
+
+        size_t rc_;
+        size_t root_index_;
+        uint8_t color_;
+    };
+
+    inline void intrusive_ptr_add_ref(cycle_collected *p) {
+        p->ref();
+    }
+
+    inline void intrusive_ptr_release(cycle_collected *p) {
+        p->deref();
+    }
+
+    inline void intrusive_ptr_add_ref(cycle_collected *p, size_t n) {
+        p->ref(n);
+    }
+
+    inline void intrusive_ptr_release(cycle_collected *p, size_t n) {
+        p->deref(n);
+    }
+
+    // Scans the calling thread's possible roots in slices of at most
+    // slice_roots roots until the buffer is empty or budget has passed, and
+    // returns the number of objects destroyed. Each slice finishes its trial
+    // deletion before the next starts, so the mutator may run freely between
+    // calls; the budget is checked between slices and one slice costs time
+    // proportional to the subgraph reachable from its roots. Nested calls
+    // from destructors return 0.
+    size_t collect_cycles(std::chrono::steady_clock::duration budget, size_t slice_roots = 64) noexcept;
+
+    // Scans until the calling thread's root buffer is empty.
+    size_t collect_all_cycles() noexcept;
+
+    // Possible roots buffered on the calling thread.
+    size_t pending_cycle_roots() noexcept;
+
+}
+
+#endif // CYCLE_COLLECTOR_HPP
@@ -0,0 +1,189 @@
+#include "deferred_reclaim.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace std {
+
+    namespace {
+
+        struct retired {
+            void *object;
+            void (*destroy)(void *);
+        };
+
+        using retire_batch = std::vector<retired>;
+
+        std::atomic<size_t> batch_size{256};
+
+        void destroy_batch(retire_batch &batch) {
+            for (auto &entry : batch) {
+                entry.destroy(entry.object);
+            }
+            batch.clear();
+        }
+
+        // Destroys batch until it stays empty. Destructors may retire more
+        // objects into it, so it is swapped out before each pass.
+        size_t drain_batch(retire_batch &batch) {
+            size_t total = 0;
+            while (!batch.empty()) {
+                retire_batch current;
+                current.swap(batch);
+                total += current.size();
+                destroy_batch(current);
+            }
+            return total;
+        }
+
+    }
+
+    struct retire_reclaimer::state {
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<retire_batch> pending;
+        bool stopping = false;
+        std::atomic<size_t> reclaimed{0};
+        std::thread worker;
+
+        void run() {
+            std::unique_lock<std::mutex> lock(mtx);
+            for (;;) {
+                cv.wait(lock, [this] { return stopping || !pending.empty(); });
+                while (!pending.empty()) {
+                    auto batch = std::move(pending.front());
+                    pending.pop_front();
+                    lock.unlock();
+                    auto count = batch.size();
+                    destroy_batch(batch);
+                    // children retired by the cascade land on this thread
+                    count += flush_retired();
+                    reclaimed.fetch_add(count, std::memory_order_relaxed);
+                    lock.lock();
+                }
+                if (stopping) {
+                    return;
+                }
+            }
+        }
+    };
+
+    namespace {
+
+        std::mutex &active_mutex() {
+            static std::mutex mtx;
+            return mtx;
+        }
+
+        retire_reclaimer::state *&active_reclaimer() {
+            static retire_reclaimer::state *active = nullptr;
+            return active;
+        }
+
+        bool handoff(retire_batch &batch) {
+            std::lock_guard<std::mutex> guard(active_mutex());
+            auto reclaimer = active_reclaimer();
+            if (!reclaimer) {
+                return false;
+            }
+            {
+                std::lock_guard<std::mutex> lock(reclaimer->mtx);
+                reclaimer->pending.push_back(std::move(batch));
+            }
+            reclaimer->cv.notify_one();
+            batch = retire_batch();
+            return true;
+        }
+
+        struct retire_list {
+            retire_batch batch;
+            bool exited = false;
+
+            ~retire_list() {
+                if (!batch.empty() && !handoff(batch)) {
+                    drain_batch(batch);
+                }
+                // objects retired by later thread-local destructors are
+                // destroyed right away
+                exited = true;
+            }
+        };
+
+        retire_list &thread_retire_list() {
+            static thread_local retire_list list;
+            return list;
+        }
+
+    }
+
+    void retire_object(void *object, void (*destroy)(void *)) noexcept {
+        auto &list = thread_retire_list();
+        if (list.exited) {
+            destroy(object);
+            return;
+        }
+        auto &batch = list.batch;
+        try {
+            batch.push_back(retired{object, destroy});
+        } catch (...) {
+            // out of memory; run the cascade here instead
+            destroy(object);
+            return;
+        }
+        if (batch.size() >= batch_size.load(std::memory_order_relaxed)) {
+            try {
+                if (handoff(batch)) {
+                    batch.reserve(batch_size.load(std::memory_order_relaxed));
+                }
+            } catch (...) {
+                // out of memory; the batch stays here and is retried later
+            }
+        }
+    }
+
+    size_t flush_retired() {
+        auto &list = thread_retire_list();
+        return list.exited ? 0 : drain_batch(list.batch);
+    }
+
+    bool handoff_retired() {
+        auto &list = thread_retire_list();
+        return list.exited || list.batch.empty() || handoff(list.batch);
+    }
+
+    void set_retire_batch_size(size_t size) noexcept {
+        batch_size.store(size ? size : 1, std::memory_order_relaxed);
+    }
+
+    retire_reclaimer::retire_reclaimer() : state_(new state) {
+        auto worker_state = state_;
+        state_->worker = std::thread([worker_state] { worker_state->run(); });
+        std::lock_guard<std::mutex> guard(active_mutex());
+        active_reclaimer() = state_;
+    }
+
+    retire_reclaimer::~retire_reclaimer() {
+        {
+            std::lock_guard<std::mutex> guard(active_mutex());
+            if (active_reclaimer() == state_) {
+                active_reclaimer() = nullptr;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(state_->mtx);
+            state_->stopping = true;
+        }
+        state_->cv.notify_one();
+        state_->worker.join();
+        delete state_;
+    }
+
+    size_t retire_reclaimer::reclaimed() const noexcept {
+        return state_->reclaimed.load(std::memory_order_relaxed);
+    }
+
+} //
@@ -0,0 +1,68 @@
+#ifndef DEFERRED_RECLAIM_HPP
+#define DEFERRED_RECLAIM_HPP
+
+#include <cstddef>
+
+#include "ref_counted.hpp"
+
+
+namespace std {
+
+    // Queues an object on the calling thread's retire list instead of
+    // destroying it. If a retire_reclaimer is running, full batches are handed
+    // to its thread; otherwise the list grows until flush_retired() or thread
+    // exit. If the list cannot grow, or is already gone because a later
+    // thread-local destructor retires the object, destroy(object) runs right
+    // away.
+    void retire_object(void *object, void (*destroy)(void *)) noexcept;
+
+    // Destroys everything retired by the calling thread so far and returns
+    // the number of destroyed objects. Call it at quiescent points.
+    size_t flush_retired();
+
+    // Hands the calling thread's retire list to the running reclaimer without
+    // waiting for a full batch. Returns false if no reclaimer is running.
+    bool handoff_retired();
+
+    // Number of retired objects collected before they are handed off.
+    void set_retire_batch_size(size_t size) noexcept;
+
+    // Background thread that destroys retired batches. At most one may exist
+    // at a time; objects still queued when it stops are destroyed by it.
+    class retire_reclaimer {
+    public:
+        retire_reclaimer();
+
+        ~retire_reclaimer();
+
+        retire_reclaimer(const retire_reclaimer &) = delete;
+
+        retire_reclaimer &operator=(const retire_reclaimer &) = delete;
+
+        size_t reclaimed() const noexcept;
+
+        struct state;
+
+    private:
+        state *state_;
+    };
+
+    // ref_counted_base whose last deref() retires the object: the destructor
+    // cascade runs on the reclaimer thread or at the next flush_retired(),
+    // never inside the releasing intrusive_ptr destructor.
+    template <class Derived, class CounterPolicy = atomic_ref_count>
+    class deferred_ref_counted : public basic_ref_counted<CounterPolicy, Derived> {
+    public:
+        static void destroy(Derived *ptr) noexcept {
+            retire_object(ptr, &destroy_now);
+        }
+
+    private:
+        static void destroy_now(void *ptr) {
+            delete static_cast<Derived *>(ptr);
+        }
+    };
+
+}
+
+#endif // DEFERRED_RECLAIM_HPP
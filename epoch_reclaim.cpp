@@ -0,0 +1,146 @@
+#include "epoch_reclaim.hpp"
+
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace std {
+
+    namespace {
+
+        // starts at 1 so that 0 can mean "not in a critical section"
+        std::atomic<uint64_t> global_epoch{1};
+
+        std::atomic<epoch_record *> records{nullptr};
+
+        struct retired {
+            void *ptr;
+            void (*reclaim)(void *);
+            uint64_t epoch;
+        };
+
+        std::mutex &orphans_mutex() {
+            static std::mutex mtx;
+            return mtx;
+        }
+
+        std::vector<retired> &orphans() {
+            static std::vector<retired> list;
+            return list;
+        }
+
+        constexpr size_t reclaim_threshold = 64;
+
+        bool try_advance() {
+            auto epoch = global_epoch.load();
+            for (auto record = records.load(); record; record = record->next) {
+                auto local = record->epoch.load();
+                if (local != 0 && local != epoch) {
+                    return false;
+                }
+            }
+            return global_epoch.compare_exchange_strong(epoch, epoch + 1);
+        }
+
+        size_t reclaim_list(std::vector<retired> &list) {
+            auto epoch = global_epoch.load();
+            std::vector<retired> ready;
+            size_t kept = 0;
+            for (auto &entry : list) {
+                if (entry.epoch + 2 <= epoch) {
+                    ready.push_back(entry);
+                } else {
+                    list[kept++] = entry;
+                }
+            }
+            list.resize(kept);
+            // reclaiming may retire more objects into list
+            for (auto &entry : ready) {
+                entry.reclaim(entry.ptr);
+            }
+            return ready.size();
+        }
+
+        struct thread_state {
+            epoch_record *record = nullptr;
+            std::vector<retired> limbo;
+
+            ~thread_state() {
+                if (!limbo.empty()) {
+                    std::lock_guard<std::mutex> guard(orphans_mutex());
+                    orphans().insert(orphans().end(), limbo.begin(), limbo.end());
+                }
+                if (record) {
+                    record->in_use.store(false, std::memory_order_release);
+                }
+            }
+        };
+
+        thread_state &local() {
+            static thread_local thread_state state;
+            return state;
+        }
+
+        epoch_record *acquire_record() {
+            for (auto record = records.load(); record; record = record->next) {
+                bool expected = false;
+                if (!record->in_use.load(std::memory_order_relaxed) &&
+                    record->in_use.compare_exchange_strong(expected, true)) {
+                    return record;
+                }
+            }
+            auto record = new epoch_record;
+            record->in_use.store(true, std::memory_order_relaxed);
+            record->next = records.load();
+            while (!records.compare_exchange_weak(record->next, record)) {
+                // retry
+            }
+            return record;
+        }
+
+    }
+
+    epoch_record *thread_epoch_record() {
+        auto &state = local();
+        if (!state.record) {
+            state.record = acquire_record();
+        }
+        return state.record;
+    }
+
+    uint64_t epoch_guard::current_epoch() noexcept {
+        return global_epoch.load();
+    }
+
+    void epoch_retire(void *ptr, void (*reclaim)(void *)) {
+        auto &limbo = local().limbo;
+        limbo.push_back(retired{ptr, reclaim, global_epoch.load()});
+        if (limbo.size() >= reclaim_threshold) {
+            epoch_reclaim();
+        }
+    }
+
+    size_t epoch_reclaim() {
+        auto &limbo = local().limbo;
+        {
+            std::unique_lock<std::mutex> guard(orphans_mutex(), std::try_to_lock);
+            if (guard.owns_lock() && !orphans().empty()) {
+                limbo.insert(limbo.end(), orphans().begin(), orphans().end());
+                orphans().clear();
+            }
+        }
+        try_advance();
+        return reclaim_list(limbo);
+    }
+
+    void epoch_synchronize() {
+        auto &limbo = local().limbo;
+        while (!limbo.empty()) {
+            if (!try_advance()) {
+                std::this_thread::yield();
+            }
+            reclaim_list(limbo);
+        }
+    }
+
+} //
@@ -0,0 +1,65 @@
+#ifndef EPOCH_RECLAIM_HPP
+#define EPOCH_RECLAIM_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+
+namespace std {
+
+    // Epoch-based reclamation.
+    //
+    // Readers mark themselves active in the current global epoch for the
+    // duration of an epoch_guard; this is a store to a thread-owned slot, no
+    // shared cache line is written. Retired objects are tagged with the epoch
+    // they were retired in and reclaimed once the global epoch has advanced
+    // twice past it, which can only happen after every reader that could
+    // have seen them has left its critical section.
+    struct epoch_record {
+        std::atomic<uint64_t> epoch{0}; // 0 while the thread is outside a guard
+        std::atomic<bool> in_use{false};
+        unsigned nesting = 0;
+        epoch_record *next = nullptr;
+    };
+
+    epoch_record *thread_epoch_record();
+
+    class epoch_guard {
+    public:
+        epoch_guard() : record_(thread_epoch_record()) {
+            if (record_->nesting++ == 0) {
+                record_->epoch.store(current_epoch());
+            }
+        }
+
+        ~epoch_guard() {
+            if (--record_->nesting == 0) {
+                record_->epoch.store(0, std::memory_order_release);
+            }
+        }
+
+        epoch_guard(const epoch_guard &) = delete;
+
+        epoch_guard &operator=(const epoch_guard &) = delete;
+
+    private:
+        static uint64_t current_epoch() noexcept;
+
+        epoch_record *record_;
+    };
+
+    // Defers reclaim(ptr) until every epoch_guard active now has ended.
+    void epoch_retire(void *ptr, void (*reclaim)(void *));
+
+    // Advances the global epoch if possible and reclaims what became safe.
+    // Never blocks; returns the number of reclaimed objects.
+    size_t epoch_reclaim();
+
+    // Blocks until everything retired so far by the calling thread has been
+    // reclaimed. Must not be called inside an epoch_guard.
+    void epoch_synchronize();
+
+}
+
+#endif // EPOCH_RECLAIM_HPP
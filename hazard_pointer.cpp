@@ -0,0 +1,133 @@
+#include "hazard_pointer.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace std {
+
+    namespace {
+
+        struct retired {
+            void *ptr;
+            void (*reclaim)(void *);
+        };
+
+        std::atomic<hazard_record *> records{nullptr};
+        std::atomic<size_t> record_count{0};
+
+        // retired objects left behind by exited threads
+        std::mutex &orphans_mutex() {
+            static std::mutex mtx;
+            return mtx;
+        }
+
+        std::vector<retired> &orphans() {
+            static std::vector<retired> list;
+            return list;
+        }
+
+        constexpr size_t cached_records = 4;
+
+        void scan(std::vector<retired> &list) {
+            std::vector<const void *> hazards;
+            for (auto record = records.load(); record; record = record->next) {
+                if (auto ptr = record->pointer.load()) {
+                    hazards.push_back(ptr);
+                }
+            }
+            std::sort(hazards.begin(), hazards.end());
+            std::vector<retired> keep;
+            std::vector<retired> reclaim;
+            for (auto &entry : list) {
+                if (std::binary_search(hazards.begin(), hazards.end(), entry.ptr)) {
+                    keep.push_back(entry);
+                } else {
+                    reclaim.push_back(entry);
+                }
+            }
+            list.swap(keep);
+            // reclaiming may retire more objects into list
+            for (auto &entry : reclaim) {
+                entry.reclaim(entry.ptr);
+            }
+        }
+
+        struct thread_hazards {
+            hazard_record *cache[cached_records];
+            size_t cached = 0;
+            std::vector<retired> retired_list;
+
+            ~thread_hazards() {
+                for (size_t i = 0; i < cached; ++i) {
+                    cache[i]->active.store(false, std::memory_order_release);
+                }
+                cached = 0;
+                scan(retired_list);
+                if (!retired_list.empty()) {
+                    std::lock_guard<std::mutex> guard(orphans_mutex());
+                    orphans().insert(orphans().end(), retired_list.begin(), retired_list.end());
+                }
+            }
+        };
+
+        thread_hazards &local() {
+            static thread_local thread_hazards hazards;
+            return hazards;
+        }
+
+    }
+
+    hazard_record *acquire_hazard_record() {
+        auto &hazards = local();
+        if (hazards.cached) {
+            return hazards.cache[--hazards.cached];
+        }
+        for (auto record = records.load(); record; record = record->next) {
+            bool expected = false;
+            if (!record->active.load(std::memory_order_relaxed) &&
+                record->active.compare_exchange_strong(expected, true)) {
+                return record;
+            }
+        }
+        auto record = new hazard_record;
+        record->active.store(true, std::memory_order_relaxed);
+        record->next = records.load();
+        while (!records.compare_exchange_weak(record->next, record)) {
+            // retry
+        }
+        record_count.fetch_add(1, std::memory_order_relaxed);
+        return record;
+    }
+
+    void release_hazard_record(hazard_record *record) noexcept {
+        record->pointer.store(nullptr, std::memory_order_release);
+        auto &hazards = local();
+        if (hazards.cached < cached_records) {
+            hazards.cache[hazards.cached++] = record;
+        } else {
+            record->active.store(false, std::memory_order_release);
+        }
+    }
+
+    void hazard_retire(void *ptr, void (*reclaim)(void *)) {
+        auto &list = local().retired_list;
+        list.push_back(retired{ptr, reclaim});
+        if (list.size() >= 2 * record_count.load(std::memory_order_relaxed) + 16) {
+            hazard_scan();
+        }
+    }
+
+    void hazard_scan() {
+        auto &list = local().retired_list;
+        {
+            std::unique_lock<std::mutex> guard(orphans_mutex(), std::try_to_lock);
+            if (guard.owns_lock() && !orphans().empty()) {
+                list.insert(list.end(), orphans().begin(), orphans().end());
+                orphans().clear();
+            }
+        }
+        scan(list);
+    }
+
+} //
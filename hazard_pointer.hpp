@@ -0,0 +1,68 @@
+#ifndef HAZARD_POINTER_HPP
+#define HAZARD_POINTER_HPP
+
+#include <atomic>
+#include <cstddef>
+
+
+namespace std {
+
+    // Slot published by a reader to keep one object from being reclaimed.
+    // Records are pooled process-wide and never freed.
+    struct hazard_record {
+        std::atomic<const void *> pointer{nullptr};
+        std::atomic<bool> active{false};
+        hazard_record *next = nullptr;
+    };
+
+    hazard_record *acquire_hazard_record();
+
+    void release_hazard_record(hazard_record *record) noexcept;
+
+    // Defers reclaim(ptr) until no hazard_guard protects ptr. Retired objects
+    // are kept per thread and scanned in batches.
+    void hazard_retire(void *ptr, void (*reclaim)(void *));
+
+    // Reclaims every object retired by the calling thread that is no longer
+    // protected.
+    void hazard_scan();
+
+    class hazard_guard {
+    public:
+        hazard_guard() : record_(acquire_hazard_record()) {}
+
+        ~hazard_guard() {
+            release_hazard_record(record_);
+        }
+
+        hazard_guard(const hazard_guard &) = delete;
+
+        hazard_guard &operator=(const hazard_guard &) = delete;
+
+        // Loads src and publishes the result until the published value is
+        // still current; the returned object cannot be reclaimed until the
+        // guard is reset or destroyed.
+        template <class T>
+        T *protect(const std::atomic<T *> &src) noexcept {
+            auto ptr = src.load();
+            for (;;) {
+                record_->pointer.store(ptr);
+                auto current = src.load();
+                if (current == ptr) {
+                    return ptr;
+                }
+                ptr = current;
+            }
+        }
+
+        void reset() noexcept {
+            record_->pointer.store(nullptr, std::memory_order_release);
+        }
+
+    private:
+        hazard_record *record_;
+    };
+
+}
+
+#endif // HAZARD_POINTER_HPP
@@ -0,0 +1,201 @@
+#ifndef INTRUSIVE_LRU_HPP
+#define INTRUSIVE_LRU_HPP
+
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "intrusive_ptr.hpp"
+
+
+namespace std {
+
+    // Links for intrusive_lru. Derive cached types from it next to their
+    // ref_counted base; an object can be in at most one cache at a time.
+    class intrusive_lru_hook {
+    public:
+        intrusive_lru_hook() noexcept = default;
+
+        intrusive_lru_hook(const intrusive_lru_hook &) noexcept {}
+
+        intrusive_lru_hook &operator=(const intrusive_lru_hook &) noexcept {
+            // nop; links are not copied
+            return *this;
+        }
+
+    private:
+        template <class T, class Key, class Hash, class KeyEqual>
+        friend class intrusive_lru;
+
+        intrusive_lru_hook *lru_prev_ = nullptr;
+        intrusive_lru_hook *lru_next_ = nullptr;
+        intrusive_lru_hook *lru_chain_ = nullptr;
+        size_t lru_hash_ = 0;
+    };
+
+    // Single-threaded LRU cache of intrusive_ptr<T>, for per-core caches.
+    //
+    // T derives from intrusive_lru_hook and exposes its key through
+    // lru_key(). The recency list and hash chains run through the hook and
+    // the bucket array is sized once from the capacity, so insert, find and
+    // eviction never allocate. The cache owns one ref per entry; callers
+    // pin an entry by holding another one. Eviction takes the least recently
+    // used entry whose count is unique among the scan_limit oldest entries,
+    // and the oldest entry if all of them are pinned; a pinned object stays
+    // alive for its holders.
+    template <class T, class Key, class Hash = std::hash<Key>, class KeyEqual = std::equal_to<Key>>
+    class intrusive_lru {
+    public:
+        explicit intrusive_lru(size_t capacity, size_t scan_limit = 16, const Hash &hash = Hash(),
+                               const KeyEqual &equal = KeyEqual())
+                : buckets_(round_up(capacity ? capacity : 1), nullptr), capacity_(capacity ? capacity : 1),
+                  scan_limit_(scan_limit ? scan_limit : 1), size_(0), hash_(hash), equal_(equal) {
+            head_.lru_prev_ = &head_;
+            head_.lru_next_ = &head_;
+        }
+
+        intrusive_lru(const intrusive_lru &) = delete;
+
+        intrusive_lru &operator=(const intrusive_lru &) = delete;
+
+        ~intrusive_lru() {
+            clear();
+        }
+
+        size_t size() const noexcept {
+            return size_;
+        }
+
+        size_t capacity() const noexcept {
+            return capacity_;
+        }
+
+        bool empty() const noexcept {
+            return size_ == 0;
+        }
+
+        // Returns the entry for key and marks it most recently used.
+        intrusive_ptr<T> find(const Key &key) noexcept {
+            auto hook = lookup(key, hash_(key));
+            if (!hook) {
+                return nullptr;
+            }
+            unlink_list(hook);
+            link_front(hook);
+            return intrusive_ptr<T>(object_of(hook));
+        }
+
+        // Inserts value as the most recently used entry, replacing an entry
+        // with the same key. Returns the replaced or evicted entry, so the
+        // caller decides where its last ref is dropped.
+        intrusive_ptr<T> insert(intrusive_ptr<T> value) noexcept {
+            auto hook = hook_of(value.get());
+            auto h = hash_(value->lru_key());
+            intrusive_ptr<T> dropped;
+            if (auto old = lookup(value->lru_key(), h)) {
+                dropped = unlink(old);
+            } else if (size_ == capacity_) {
+                dropped = unlink(pick_victim());
+            }
+            hook->lru_hash_ = h;
+            auto &bucket = bucket_of(h);
+            hook->lru_chain_ = bucket;
+            bucket = hook;
+            link_front(hook);
+            value.detach();
+            ++size_;
+            return dropped;
+        }
+
+        // Removes and returns the entry for key.
+        intrusive_ptr<T> erase(const Key &key) noexcept {
+            auto hook = lookup(key, hash_(key));
+            return hook ? unlink(hook) : nullptr;
+        }
+
+        void clear() noexcept {
+            while (head_.lru_next_ != &head_) {
+                unlink(head_.lru_next_);
+            }
+        }
+
+    private:
+        static inline size_t round_up(size_t size) noexcept {
+            size_t result = 1;
+            while (result < size) {
+                result <<= 1;
+            }
+            return result;
+        }
+
+        static inline intrusive_lru_hook *hook_of(T *ptr) noexcept {
+            return static_cast<intrusive_lru_hook *>(ptr);
+        }
+
+        static inline T *object_of(intrusive_lru_hook *hook) noexcept {
+            return static_cast<T *>(hook);
+        }
+
+        inline intrusive_lru_hook *&bucket_of(size_t h) noexcept {
+            return buckets_[h & (buckets_.size() - 1)];
+        }
+
+        intrusive_lru_hook *lookup(const Key &key, size_t h) noexcept {
+            for (auto hook = bucket_of(h); hook; hook = hook->lru_chain_) {
+                if (hook->lru_hash_ == h && equal_(object_of(hook)->lru_key(), key)) {
+                    return hook;
+                }
+            }
+            return nullptr;
+        }
+
+        intrusive_lru_hook *pick_victim() noexcept {
+            auto hook = head_.lru_prev_;
+            for (size_t i = 0; i < scan_limit_ && hook != &head_; ++i, hook = hook->lru_prev_) {
+                if (object_of(hook)->unique()) {
+                    return hook;
+                }
+            }
+            return head_.lru_prev_;
+        }
+
+        inline void link_front(intrusive_lru_hook *hook) noexcept {
+            hook->lru_prev_ = &head_;
+            hook->lru_next_ = head_.lru_next_;
+            head_.lru_next_->lru_prev_ = hook;
+            head_.lru_next_ = hook;
+        }
+
+        inline void unlink_list(intrusive_lru_hook *hook) noexcept {
+            hook->lru_prev_->lru_next_ = hook->lru_next_;
+            hook->lru_next_->lru_prev_ = hook->lru_prev_;
+        }
+
+        // Takes hook out of the list and its chain and hands back the
+        // cache's ref.
+        intrusive_ptr<T> unlink(intrusive_lru_hook *hook) noexcept {
+            unlink_list(hook);
+            for (auto link = &bucket_of(hook->lru_hash_); *link; link = &(*link)->lru_chain_) {
+                if (*link == hook) {
+                    *link = hook->lru_chain_;
+                    break;
+                }
+            }
+            hook->lru_prev_ = hook->lru_next_ = hook->lru_chain_ = nullptr;
+            --size_;
+            return intrusive_ptr<T>(object_of(hook), false);
+        }
+
+        std::vector<intrusive_lru_hook *> buckets_;
+        intrusive_lru_hook head_;
+        const size_t capacity_;
+        const size_t scan_limit_;
+        size_t size_;
+        Hash hash_;
+        KeyEqual equal_;
+    };
+
+}
+
+#endif // INTRUSIVE_LRU_HPP
@@ -2,12 +2,35 @@
 #define INTRUSIVE_PTR_HPP
 //C++ 11 intrusive_ptr
 //frindle api for boost
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
 #include <memory>
+#include <type_traits>
 #include <utility>
+#include <vector>
 #include "ref_counted.hpp"
 
 namespace std {
 
+    // Ownership tags for raw pointers: adopt_ref takes over a ref the caller
+    // already owns, borrow_ref adds a new one. Equivalent to passing
+    // add_ref = false and true.
+    struct adopt_ref_t {
+        explicit adopt_ref_t() = default;
+    };
+
+    struct borrow_ref_t {
+        explicit borrow_ref_t() = default;
+    };
+
+    constexpr adopt_ref_t adopt_ref{};
+
+    constexpr borrow_ref_t borrow_ref{};
+
     template<class T>
     class intrusive_ptr {
     public:
@@ -23,6 +46,12 @@ namespace std {
             set_ptr(raw_ptr, add_ref);
         }
 
+        intrusive_ptr(pointer raw_ptr, adopt_ref_t) noexcept : ptr_(raw_ptr) {}
+
+        intrusive_ptr(pointer raw_ptr, borrow_ref_t) noexcept {
+            set_ptr(raw_ptr, true);
+        }
+
         intrusive_ptr(intrusive_ptr &&other) noexcept : ptr_(other.detach()) {}
 
         intrusive_ptr(const intrusive_ptr &other) noexcept {
@@ -30,17 +59,43 @@ namespace std {
         }
 
         template<class Y>
-        intrusive_ptr(intrusive_ptr<Y> other) : ptr_(other.detach()) {
+        intrusive_ptr(intrusive_ptr<Y> &&other) noexcept : ptr_(other.detach()) {
             static_assert(std::is_convertible<Y *, T *>::value, "Y* is not assignable to T*");
         }
 
+        template<class Y>
+        intrusive_ptr(const intrusive_ptr<Y> &other) noexcept {
+            static_assert(std::is_convertible<Y *, T *>::value, "Y* is not assignable to T*");
+            set_ptr(other.get(), true);
+        }
+
         intrusive_ptr &operator=(pointer ptr) noexcept {
             reset(ptr);
             return *this;
         }
 
-        intrusive_ptr &operator=(intrusive_ptr other) noexcept {
-            swap(other);
+        intrusive_ptr &operator=(const intrusive_ptr &other) noexcept {
+            reset(other.get());
+            return *this;
+        }
+
+        // Takes over other's ref; only the old value is released.
+        intrusive_ptr &operator=(intrusive_ptr &&other) noexcept {
+            reset(other.detach(), false);
+            return *this;
+        }
+
+        template<class Y>
+        intrusive_ptr &operator=(const intrusive_ptr<Y> &other) noexcept {
+            static_assert(std::is_convertible<Y *, T *>::value, "Y* is not assignable to T*");
+            reset(other.get());
+            return *this;
+        }
+
+        template<class Y>
+        intrusive_ptr &operator=(intrusive_ptr<Y> &&other) noexcept {
+            static_assert(std::is_convertible<Y *, T *>::value, "Y* is not assignable to T*");
+            reset(other.detach(), false);
             return *this;
         }
 
@@ -70,6 +125,14 @@ namespace std {
             }
         }
 
+        void reset(pointer new_value, adopt_ref_t) noexcept {
+            reset(new_value, false);
+        }
+
+        void reset(pointer new_value, borrow_ref_t) noexcept {
+            reset(new_value, true);
+        }
+
         pointer get() const noexcept {
             return ptr_;
         }
@@ -90,16 +153,54 @@ namespace std {
             std::swap(ptr_, other.ptr_);
         }
 
+        // Writes n copies of this pointer to out with a single add_ref(n).
+        template<class OutputIt>
+        OutputIt share_n(size_t n, OutputIt out) const {
+            if (ptr_ && n) {
+                intrusive_ptr_add_ref(ptr_, n);
+            }
+            for (size_t i = 0; i < n; ++i) {
+                *out++ = intrusive_ptr(ptr_, false);
+            }
+            return out;
+        }
+
         template<class C>
-        intrusive_ptr<C> down_pointer_cast() const noexcept {
+        intrusive_ptr<C> down_pointer_cast() const & noexcept {
             return (ptr_) ? dynamic_cast<C *>(get()) : nullptr;
         }
 
+        // Moves the ref into the result; a failed cast leaves this pointer
+        // untouched.
+        template<class C>
+        intrusive_ptr<C> down_pointer_cast() && noexcept {
+            auto result = (ptr_) ? dynamic_cast<C *>(ptr_) : nullptr;
+            if (result) {
+                ptr_ = nullptr;
+            }
+            return intrusive_ptr<C>(result, adopt_ref);
+        }
+
         template<class C>
-        intrusive_ptr<C> up_pointer_cast() const noexcept {
+        intrusive_ptr<C> up_pointer_cast() const & noexcept {
             return (ptr_) ? static_cast<C *>(get()) : nullptr;
         }
 
+        template<class C>
+        intrusive_ptr<C> up_pointer_cast() && noexcept {
+            return intrusive_ptr<C>(static_cast<C *>(detach()), adopt_ref);
+        }
+
+        template<class C>
+        intrusive_ptr<C> const_pointer_cast() const & noexcept {
+            return intrusive_ptr<C>(const_cast<C *>(get()));
+        }
+
+        template<class C>
+        intrusive_ptr<C> const_pointer_cast() && noexcept {
+            return intrusive_ptr<C>(const_cast<C *>(detach()), adopt_ref);
+        }
+
     private:
         inline void set_ptr(pointer raw_ptr, bool add_ref) noexcept {
             ptr_ = raw_ptr;
@@ -111,6 +212,38 @@ namespace std {
         pointer ptr_;
     };
 
+    // Releases every pointer in [first, last), leaving them null. Identical
+    // pointers are grouped so each object gets one release(n).
+    template <class ForwardIt>
+    void batch_release(ForwardIt first, ForwardIt last) {
+        using pointer = typename iterator_traits<ForwardIt>::value_type::pointer;
+        std::vector<pointer> raw;
+        raw.reserve(static_cast<size_t>(std::distance(first, last)));
+        for (; first != last; ++first) {
+            if (auto ptr = first->detach()) {
+                raw.push_back(ptr);
+            }
+        }
+        std::sort(raw.begin(), raw.end(), std::less<pointer>());
+        for (size_t i = 0; i < raw.size();) {
+            auto j = i + 1;
+            while (j < raw.size() && raw[j] == raw[i]) {
+                ++j;
+            }
+            intrusive_ptr_release(raw[i], j - i);
+            i = j;
+        }
+    }
+
+    // Types that can be moved to new storage with memcpy, skipping the move
+    // constructor and the destructor of the source. intrusive_ptr is one raw
+    // pointer, so relocating it never touches the reference count.
+    template <class T>
+    struct trivially_relocatable : is_trivially_copyable<T> {};
+
+    template <class T>
+    struct trivially_relocatable<intrusive_ptr<T>> : true_type {};
+
     template <class T>
     bool operator==(const intrusive_ptr<T>& x, std::nullptr_t) {
         return !x;
@@ -163,7 +296,10 @@ namespace std {
     }
 
     template<class T, class U>
-    bool operator<(intrusive_ptr<T> const &a, intrusive_ptr<U> const &b) noexcept; // never throws
+    bool operator<(intrusive_ptr<T> const &a, intrusive_ptr<U> const &b) noexcept {
+        using pointer = typename common_type<T *, U *>::type;
+        return std::less<pointer>()(a.get(), b.get());
+    }
 
     template<class T>
     inline void swap(intrusive_ptr<T> &a, intrusive_ptr<T> &b) noexcept {
@@ -180,21 +316,237 @@ namespace std {
         return r.template up_pointer_cast<T>();
     }
 
+    // The rvalue casts move the ref into the result without touching the
+    // count; dynamic_pointer_cast leaves r untouched if the cast fails.
+    template<class T, class U>
+    intrusive_ptr<T> static_pointer_cast(intrusive_ptr<U> &&r) noexcept {
+        return std::move(r).template up_pointer_cast<T>();
+    }
+
+    template<class T, class U>
+    intrusive_ptr<T> const_pointer_cast(intrusive_ptr<U> const &r) noexcept {
+        return r.template const_pointer_cast<T>();
+    }
+
     template<class T, class U>
-    intrusive_ptr<T> const_pointer_cast(intrusive_ptr<U> const &r) noexcept; // never throws
+    intrusive_ptr<T> const_pointer_cast(intrusive_ptr<U> &&r) noexcept {
+        return std::move(r).template const_pointer_cast<T>();
+    }
 
     template<class T, class U>
     intrusive_ptr<T> dynamic_pointer_cast(intrusive_ptr<U> const &r) noexcept {
         return r.template down_pointer_cast<T>();
     }
 
+    template<class T, class U>
+    intrusive_ptr<T> dynamic_pointer_cast(intrusive_ptr<U> &&r) noexcept {
+        return std::move(r).template down_pointer_cast<T>();
+    }
+
+    // intrusive_ptr that keeps a Bits-wide tag in the low bits of the pointer,
+    // which alignof(T) guarantees to be zero. Refcounting is the same as for
+    // intrusive_ptr; comparison and hashing use pointer and tag together, so
+    // one object reached through two differently tagged edges compares
+    // unequal. T may be incomplete where the type is named; the alignment
+    // check fires where a pointer is stored.
+    template<class T, unsigned Bits>
+    class tagged_intrusive_ptr {
+    public:
+        using pointer = T*;
+        using element_type = T;
+        using reference = T&;
+        using tag_type = uintptr_t;
+
+        static_assert(Bits > 0 && Bits < sizeof(uintptr_t) * 8, "tag must fit into a pointer");
+
+        static constexpr tag_type tag_mask = (tag_type{1} << Bits) - 1;
+
+        constexpr tagged_intrusive_ptr() noexcept : bits_(0) {}
+
+        tagged_intrusive_ptr(pointer raw_ptr, tag_type tag = 0, bool add_ref = true) noexcept {
+            set(raw_ptr, tag, add_ref);
+        }
+
+        tagged_intrusive_ptr(intrusive_ptr<T> ptr, tag_type tag = 0) noexcept {
+            set(ptr.detach(), tag, false);
+        }
+
+        tagged_intrusive_ptr(tagged_intrusive_ptr &&other) noexcept : bits_(other.bits_) {
+            other.bits_ = 0;
+        }
+
+        tagged_intrusive_ptr(const tagged_intrusive_ptr &other) noexcept : bits_(other.bits_) {
+            if (auto ptr = get()) {
+                intrusive_ptr_add_ref(ptr);
+            }
+        }
+
+        tagged_intrusive_ptr &operator=(tagged_intrusive_ptr other) noexcept {
+            swap(other);
+            return *this;
+        }
+
+        ~tagged_intrusive_ptr() {
+            if (auto ptr = get()) {
+                intrusive_ptr_release(ptr);
+            }
+        }
+
+        // Gives up the reference; the tag is dropped.
+        pointer detach() noexcept {
+            auto result = get();
+            bits_ = 0;
+            return result;
+        }
+
+        void reset(pointer new_value = nullptr, tag_type tag = 0, bool add_ref = true) noexcept {
+            auto old = get();
+            set(new_value, tag, add_ref);
+            if (old) {
+                intrusive_ptr_release(old);
+            }
+        }
+
+        pointer get() const noexcept {
+            return reinterpret_cast<pointer>(bits_ & ~tag_mask);
+        }
+
+        tag_type tag() const noexcept {
+            return bits_ & tag_mask;
+        }
+
+        void set_tag(tag_type tag) noexcept {
+            check_tag(tag);
+            bits_ = (bits_ & ~tag_mask) | tag;
+        }
+
+        // Raw pointer and tag as one word, for comparison and hashing.
+        uintptr_t word() const noexcept {
+            return bits_;
+        }
+
+        // A new strong ref to the same object, without the tag.
+        intrusive_ptr<T> to_intrusive() const noexcept {
+            return intrusive_ptr<T>(get());
+        }
+
+        pointer operator->() const noexcept {
+            return get();
+        }
+
+        reference operator*() const {
+            return *get();
+        }
+
+        explicit operator bool() const noexcept {
+            return get() != nullptr;
+        }
+
+        void swap(tagged_intrusive_ptr &other) noexcept {
+            std::swap(bits_, other.bits_);
+        }
+
+    private:
+        static inline void check_tag(tag_type tag) noexcept {
+            static_assert((tag_type{1} << Bits) <= alignof(T), "alignof(T) leaves fewer than Bits free low bits");
+            assert(tag <= tag_mask && "tag does not fit into Bits");
+            (void) tag;
+        }
+
+        inline void set(pointer raw_ptr, tag_type tag, bool add_ref) noexcept {
+            check_tag(tag);
+            bits_ = reinterpret_cast<uintptr_t>(raw_ptr) | tag;
+            if (raw_ptr && add_ref) {
+                intrusive_ptr_add_ref(raw_ptr);
+            }
+        }
+
+        uintptr_t bits_;
+    };
+
+    template<class T, unsigned Bits>
+    constexpr typename tagged_intrusive_ptr<T, Bits>::tag_type tagged_intrusive_ptr<T, Bits>::tag_mask;
+
+    template<class T, unsigned Bits>
+    struct trivially_relocatable<tagged_intrusive_ptr<T, Bits>> : true_type {};
+
+    template<class T, unsigned Bits>
+    bool operator==(tagged_intrusive_ptr<T, Bits> const &a, tagged_intrusive_ptr<T, Bits> const &b) noexcept {
+        return a.word() == b.word();
+    }
+
+    template<class T, unsigned Bits>
+    bool operator!=(tagged_intrusive_ptr<T, Bits> const &a, tagged_intrusive_ptr<T, Bits> const &b) noexcept {
+        return a.word() != b.word();
+    }
+
+    template<class T, unsigned Bits>
+    bool operator<(tagged_intrusive_ptr<T, Bits> const &a, tagged_intrusive_ptr<T, Bits> const &b) noexcept {
+        return a.word() < b.word();
+    }
+
+    template<class T, unsigned Bits>
+    bool operator==(tagged_intrusive_ptr<T, Bits> const &x, std::nullptr_t) noexcept {
+        return !x;
+    }
+
+    template<class T, unsigned Bits>
+    bool operator!=(tagged_intrusive_ptr<T, Bits> const &x, std::nullptr_t) noexcept {
+        return static_cast<bool>(x);
+    }
+
+    template<class T, unsigned Bits>
+    inline void swap(tagged_intrusive_ptr<T, Bits> &a, tagged_intrusive_ptr<T, Bits> &b) noexcept {
+        a.swap(b);
+    }
+
+    template<class T, unsigned Bits>
+    T *get_pointer(tagged_intrusive_ptr<T, Bits> const &p) noexcept {
+        return p.get();
+    }
+
+    // Types derived from allocated_ref_counted (allocate_intrusive.hpp) must be
+    // created through allocate_intrusive, so make_intrusive routes them there.
+    template <class T, class = void>
+    struct uses_intrusive_allocator : false_type {};
+
+    template <class T>
+    struct uses_intrusive_allocator<T, typename conditional<true, void, typename T::intrusive_allocated_type>::type>
+            : true_type {};
+
+    // Before C++17 new T only honours alignment beyond max_align_t when T
+    // brings its own operator new, as sharded_ref_counted does.
+    template <class T, class = void>
+    struct has_class_operator_new : false_type {};
+
+    template <class T>
+    struct has_class_operator_new<T, typename conditional<true, void,
+            decltype(T::operator new(std::declval<size_t>()))>::type> : true_type {};
+
+    template <class T, class... Args>
+    inline typename enable_if<!uses_intrusive_allocator<T>::value, intrusive_ptr<T>>::type
+    make_intrusive(Args &&... args) {
+#ifndef __cpp_aligned_new
+        static_assert(alignof(T) <= alignof(max_align_t) || has_class_operator_new<T>::value,
+                      "over-aligned T needs a class operator new before C++17");
+#endif
+        return intrusive_ptr<T>(new T(std::forward<Args>(args)...), false);
+    }
+
     template<typename T>
     struct hash<intrusive_ptr<T>>   {
         size_t operator()(const intrusive_ptr<T>& ptr) const noexcept {
-            using pointer_t = intrusive_ptr<_Tp> ;
+            using pointer_t = intrusive_ptr<T>;
             return std::hash<typename pointer_t::pointer>()(ptr.get());
         }
     };
 
+    template<typename T, unsigned Bits>
+    struct hash<tagged_intrusive_ptr<T, Bits>>   {
+        size_t operator()(const tagged_intrusive_ptr<T, Bits>& ptr) const noexcept {
+            return std::hash<uintptr_t>()(ptr.word());
+        }
+    };
+
 }
 #endif //INTRUSIVE_PTR_HPP
@@ -0,0 +1,210 @@
+#ifndef INTRUSIVE_QUEUE_HPP
+#define INTRUSIVE_QUEUE_HPP
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+
+#include "intrusive_ptr.hpp"
+
+
+namespace std {
+
+    // Link field for intrusive_mpsc_queue. Derive queued types from it next
+    // to their ref_counted base, so enqueueing needs no node allocation. An
+    // object can be in at most one queue at a time.
+    class intrusive_queue_hook {
+    public:
+        intrusive_queue_hook() noexcept : queue_next_(nullptr) {}
+
+        intrusive_queue_hook(const intrusive_queue_hook &) noexcept : queue_next_(nullptr) {}
+
+        intrusive_queue_hook &operator=(const intrusive_queue_hook &) noexcept {
+            // nop; links are not copied
+            return *this;
+        }
+
+    private:
+        template <class T>
+        friend class intrusive_mpsc_queue;
+
+        std::atomic<intrusive_queue_hook *> queue_next_;
+    };
+
+    // Unbounded multi-producer single-consumer queue (Vyukov) threaded
+    // through intrusive_queue_hook. push() takes over the caller's ref and
+    // pop() hands it back, so a transfer costs no refcount operation.
+    // Producers are wait-free; pop() must only be called from one thread at
+    // a time and may briefly report empty while a push is half done.
+    template <class T>
+    class intrusive_mpsc_queue {
+    public:
+        intrusive_mpsc_queue() noexcept : head_(&stub_), tail_(&stub_) {}
+
+        intrusive_mpsc_queue(const intrusive_mpsc_queue &) = delete;
+
+        intrusive_mpsc_queue &operator=(const intrusive_mpsc_queue &) = delete;
+
+        ~intrusive_mpsc_queue() {
+            while (pop()) {
+                // nop; releases the popped ref
+            }
+        }
+
+        // ptr must not be null: pop() reports an empty queue with null.
+        void push(intrusive_ptr<T> &&ptr) noexcept {
+            assert(ptr && "pushing a null pointer");
+            push_hook(hook_of(ptr.detach()));
+        }
+
+        intrusive_ptr<T> pop() noexcept {
+            auto tail = tail_;
+            auto next = tail->queue_next_.load(std::memory_order_acquire);
+            if (tail == &stub_) {
+                if (!next) {
+                    return nullptr;
+                }
+                tail_ = next;
+                tail = next;
+                next = next->queue_next_.load(std::memory_order_acquire);
+            }
+            if (next) {
+                tail_ = next;
+                return adopt(tail);
+            }
+            if (tail != head_.load(std::memory_order_acquire)) {
+                // a producer has swapped head_ but not linked its node yet
+                return nullptr;
+            }
+            push_hook(&stub_);
+            next = tail->queue_next_.load(std::memory_order_acquire);
+            if (next) {
+                tail_ = next;
+                return adopt(tail);
+            }
+            return nullptr;
+        }
+
+        // Consumer-side snapshot.
+        bool empty() const noexcept {
+            return tail_ == &stub_ && !stub_.queue_next_.load(std::memory_order_acquire);
+        }
+
+    private:
+        static inline intrusive_queue_hook *hook_of(T *ptr) noexcept {
+            return static_cast<intrusive_queue_hook *>(ptr);
+        }
+
+        static inline intrusive_ptr<T> adopt(intrusive_queue_hook *hook) noexcept {
+            return intrusive_ptr<T>(static_cast<T *>(hook), false);
+        }
+
+        inline void push_hook(intrusive_queue_hook *hook) noexcept {
+            hook->queue_next_.store(nullptr, std::memory_order_relaxed);
+            auto prev = head_.exchange(hook, std::memory_order_acq_rel);
+            prev->queue_next_.store(hook, std::memory_order_release);
+        }
+
+        alignas(64) std::atomic<intrusive_queue_hook *> head_;
+        alignas(64) intrusive_queue_hook *tail_;
+        intrusive_queue_hook stub_;
+    };
+
+    // Bounded multi-producer multi-consumer ring (Vyukov) of detached
+    // intrusive_ptr<T>. Any T works; no hook is needed. Ownership moves in
+    // and out the same way as in intrusive_mpsc_queue.
+    template <class T>
+    class intrusive_mpmc_queue {
+    public:
+        // capacity is rounded up to a power of two.
+        explicit intrusive_mpmc_queue(size_t capacity) : mask_(round_up(capacity) - 1),
+                                                         cells_(new cell[mask_ + 1]) {
+            for (size_t i = 0; i <= mask_; ++i) {
+                cells_[i].sequence.store(i, std::memory_order_relaxed);
+            }
+            enqueue_pos_.store(0, std::memory_order_relaxed);
+            dequeue_pos_.store(0, std::memory_order_relaxed);
+        }
+
+        intrusive_mpmc_queue(const intrusive_mpmc_queue &) = delete;
+
+        intrusive_mpmc_queue &operator=(const intrusive_mpmc_queue &) = delete;
+
+        ~intrusive_mpmc_queue() {
+            intrusive_ptr<T> ptr;
+            while (try_pop(ptr)) {
+                ptr.reset();
+            }
+        }
+
+        size_t capacity() const noexcept {
+            return mask_ + 1;
+        }
+
+        // Leaves ptr untouched and returns false when the ring is full.
+        bool try_push(intrusive_ptr<T> &&ptr) noexcept {
+            auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+            for (;;) {
+                auto &slot = cells_[pos & mask_];
+                auto sequence = slot.sequence.load(std::memory_order_acquire);
+                auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+                if (diff == 0) {
+                    if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        slot.value = ptr.detach();
+                        slot.sequence.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = enqueue_pos_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Adopts the oldest element into out; returns false when empty.
+        bool try_pop(intrusive_ptr<T> &out) noexcept {
+            auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+            for (;;) {
+                auto &slot = cells_[pos & mask_];
+                auto sequence = slot.sequence.load(std::memory_order_acquire);
+                auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+                if (diff == 0) {
+                    if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        auto value = slot.value;
+                        slot.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                        out.reset(value, false);
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = dequeue_pos_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+    private:
+        struct cell {
+            std::atomic<size_t> sequence;
+            T *value;
+        };
+
+        static inline size_t round_up(size_t capacity) noexcept {
+            size_t result = 2;
+            while (result < capacity) {
+                result <<= 1;
+            }
+            return result;
+        }
+
+        const size_t mask_;
+        std::unique_ptr<cell[]> cells_;
+        alignas(64) std::atomic<size_t> enqueue_pos_;
+        alignas(64) std::atomic<size_t> dequeue_pos_;
+    };
+
+}
+
+#endif // INTRUSIVE_QUEUE_HPP
@@ -0,0 +1,278 @@
+#ifndef INTRUSIVE_TASK_HPP
+#define INTRUSIVE_TASK_HPP
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+
+#include <atomic>
+#include <cassert>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "intrusive_ptr.hpp"
+#include "ref_counted.hpp"
+#include "slab_allocator.hpp"
+
+
+namespace std {
+
+    template <class T = void>
+    class intrusive_task;
+
+    namespace intrusive_detail {
+
+        // Promise of intrusive_task coroutines. The promise is the ref_counted
+        // object: intrusive_task handles hold refs to it, and a started
+        // coroutine holds one more until it reaches its final suspend point,
+        // so dropping every handle never frees a frame that is still running.
+        // The last deref() destroys the coroutine, which frees the frame
+        // through the slab heaps.
+        //
+        // state_ is null while nobody waits, the awaiting coroutine once one
+        // does, and the promise's own address after completion; awaiter and
+        // completing coroutine race on it with a single exchange each.
+        template <class Promise>
+        class task_promise_base : public basic_ref_counted<atomic_ref_count, Promise> {
+        public:
+            static void *operator new(size_t size) {
+                return slab_allocate(size);
+            }
+
+            static void operator delete(void *ptr) noexcept {
+                slab_deallocate(ptr);
+            }
+
+            static void destroy(Promise *ptr) noexcept {
+                coroutine_handle<Promise>::from_promise(*ptr).destroy();
+            }
+
+            struct final_awaiter {
+                bool await_ready() const noexcept {
+                    return false;
+                }
+
+                coroutine_handle<> await_suspend(coroutine_handle<Promise> handle) noexcept {
+                    auto &promise = handle.promise();
+                    auto waiter = promise.state_.exchange(promise.finished_marker(), std::memory_order_acq_rel);
+                    // may destroy this frame; waiter holds its own handle
+                    promise.deref();
+                    return waiter ? coroutine_handle<>::from_address(waiter) : noop_coroutine();
+                }
+
+                void await_resume() const noexcept {
+                    // nop
+                }
+            };
+
+            suspend_always initial_suspend() const noexcept {
+                return {};
+            }
+
+            final_awaiter final_suspend() const noexcept {
+                return {};
+            }
+
+            void unhandled_exception() noexcept {
+                exception_ = current_exception();
+            }
+
+            inline bool is_ready() const noexcept {
+                return state_.load(std::memory_order_acquire) == finished_marker();
+            }
+
+            // Runs the coroutine up to its first suspension on the calling
+            // thread. Does nothing if it was started before.
+            void start() noexcept {
+                if (!started_.exchange(true, std::memory_order_relaxed)) {
+                    this->ref();
+                    handle().resume();
+                }
+            }
+
+            // Registers waiter and returns the coroutine to resume next:
+            // this one if it has not started yet, the waiter itself if this
+            // one already finished, nothing otherwise. There is a single
+            // continuation slot: at most one coroutine may wait at a time.
+            coroutine_handle<> await(coroutine_handle<> waiter) noexcept {
+                if (!started_.exchange(true, std::memory_order_relaxed)) {
+                    state_.store(waiter.address(), std::memory_order_relaxed);
+                    this->ref();
+                    return handle();
+                }
+                void *expected = nullptr;
+                if (state_.compare_exchange_strong(expected, waiter.address(), std::memory_order_acq_rel)) {
+                    return noop_coroutine();
+                }
+                assert(expected == finished_marker() && "intrusive_task awaited twice");
+                return waiter;
+            }
+
+        protected:
+            task_promise_base() noexcept : state_(nullptr), started_(false) {}
+
+            inline void rethrow_if_failed() const {
+                if (exception_) {
+                    rethrow_exception(exception_);
+                }
+            }
+
+        private:
+            inline coroutine_handle<Promise> handle() noexcept {
+                return coroutine_handle<Promise>::from_promise(static_cast<Promise &>(*this));
+            }
+
+            inline void *finished_marker() const noexcept {
+                return const_cast<task_promise_base *>(this);
+            }
+
+            std::atomic<void *> state_;
+            std::atomic<bool> started_;
+            exception_ptr exception_;
+        };
+
+        template <class T>
+        class task_promise : public task_promise_base<task_promise<T>> {
+        public:
+            static_assert(!is_reference<T>::value, "intrusive_task does not hold references");
+
+            task_promise() noexcept : has_value_(false) {}
+
+            ~task_promise() {
+                if (has_value_) {
+                    value().~T();
+                }
+            }
+
+            intrusive_task<T> get_return_object() noexcept;
+
+            template <class U>
+            void return_value(U &&value) {
+                ::new (static_cast<void *>(storage_)) T(std::forward<U>(value));
+                has_value_ = true;
+            }
+
+            T &result() {
+                this->rethrow_if_failed();
+                return value();
+            }
+
+        private:
+            inline T &value() noexcept {
+                return *reinterpret_cast<T *>(storage_);
+            }
+
+            alignas(T) unsigned char storage_[sizeof(T)];
+            bool has_value_;
+        };
+
+        template <>
+        class task_promise<void> : public task_promise_base<task_promise<void>> {
+        public:
+            intrusive_task<void> get_return_object() noexcept;
+
+            void return_void() const noexcept {
+                // nop
+            }
+
+            void result() const {
+                rethrow_if_failed();
+            }
+        };
+
+    }
+
+    // Lazily started coroutine whose frame is reference counted.
+    //
+    // co_await on a task starts it if needed and resumes the awaiting
+    // coroutine when it finishes, through the continuation slot in the
+    // promise: no shared state is allocated besides the frame. start() runs
+    // a task without awaiting it; is_ready() and result() then observe it.
+    // Copies share the frame. Until the task finishes at most one coroutine
+    // may be suspended on it; awaiting it again once it is ready is fine.
+    template <class T>
+    class intrusive_task {
+    public:
+        using promise_type = intrusive_detail::task_promise<T>;
+
+        intrusive_task() noexcept = default;
+
+        explicit intrusive_task(intrusive_ptr<promise_type> frame) noexcept : frame_(std::move(frame)) {}
+
+        explicit operator bool() const noexcept {
+            return static_cast<bool>(frame_);
+        }
+
+        bool is_ready() const noexcept {
+            return frame_->is_ready();
+        }
+
+        void start() const noexcept {
+            frame_->start();
+        }
+
+        // Only valid once is_ready(); rethrows an exception that escaped the
+        // coroutine.
+        decltype(auto) result() const {
+            return frame_->result();
+        }
+
+        struct awaiter {
+            promise_type *promise;
+
+            bool await_ready() const noexcept {
+                return promise->is_ready();
+            }
+
+            coroutine_handle<> await_suspend(coroutine_handle<> waiter) const noexcept {
+                return promise->await(waiter);
+            }
+
+            decltype(auto) await_resume() const {
+                return promise->result();
+            }
+        };
+
+        struct move_awaiter : awaiter {
+            decltype(auto) await_resume() const {
+                if constexpr (is_void<T>::value) {
+                    this->promise->result();
+                } else {
+                    return std::move(this->promise->result());
+                }
+            }
+        };
+
+        awaiter operator co_await() const & noexcept {
+            return awaiter{frame_.get()};
+        }
+
+        // Awaiting a temporary moves the result out.
+        move_awaiter operator co_await() const && noexcept {
+            return move_awaiter{{frame_.get()}};
+        }
+
+    private:
+        intrusive_ptr<promise_type> frame_;
+    };
+
+    namespace intrusive_detail {
+
+        template <class T>
+        inline intrusive_task<T> task_promise<T>::get_return_object() noexcept {
+            return intrusive_task<T>(intrusive_ptr<task_promise>(this, false));
+        }
+
+        inline intrusive_task<void> task_promise<void>::get_return_object() noexcept {
+            return intrusive_task<void>(intrusive_ptr<task_promise>(this, false));
+        }
+
+    }
+
+}
+
+#endif // __cpp_impl_coroutine
+
+#endif // INTRUSIVE_TASK_HPP
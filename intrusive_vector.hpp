@@ -0,0 +1,311 @@
+#ifndef INTRUSIVE_VECTOR_HPP
+#define INTRUSIVE_VECTOR_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+#include "intrusive_ptr.hpp"
+
+
+namespace std {
+
+    // Vector of intrusive_ptr<T> with InlineCapacity elements of in-place
+    // storage. Growing, inserting, erasing and sorting relocate the stored
+    // pointers with memcpy/memmove/realloc, so none of them touches the
+    // reference count of an element.
+    template <class T, size_t InlineCapacity = 8>
+    class intrusive_vector {
+    public:
+        using value_type = intrusive_ptr<T>;
+        using size_type = size_t;
+        using reference = value_type &;
+        using const_reference = const value_type &;
+        using iterator = value_type *;
+        using const_iterator = const value_type *;
+
+        static_assert(trivially_relocatable<value_type>::value, "intrusive_ptr must be trivially relocatable");
+        static_assert(sizeof(value_type) == sizeof(T *), "intrusive_ptr must be a single raw pointer");
+        static_assert(InlineCapacity > 0, "InlineCapacity must be at least 1");
+
+        intrusive_vector() noexcept : data_(inline_data()), size_(0), capacity_(InlineCapacity) {}
+
+        intrusive_vector(std::initializer_list<value_type> values) : intrusive_vector() {
+            reserve(values.size());
+            for (auto &value : values) {
+                push_back(value);
+            }
+        }
+
+        intrusive_vector(const intrusive_vector &other) : intrusive_vector() {
+            reserve(other.size_);
+            for (auto &value : other) {
+                ::new (static_cast<void *>(data_ + size_)) value_type(value);
+                ++size_;
+            }
+        }
+
+        intrusive_vector(intrusive_vector &&other) noexcept : intrusive_vector() {
+            steal(other);
+        }
+
+        ~intrusive_vector() {
+            clear();
+            release_storage();
+        }
+
+        intrusive_vector &operator=(const intrusive_vector &other) {
+            if (this != &other) {
+                intrusive_vector copy(other);
+                swap(copy);
+            }
+            return *this;
+        }
+
+        intrusive_vector &operator=(intrusive_vector &&other) noexcept {
+            if (this != &other) {
+                clear();
+                release_storage();
+                data_ = inline_data();
+                capacity_ = InlineCapacity;
+                steal(other);
+            }
+            return *this;
+        }
+
+        iterator begin() noexcept {
+            return data_;
+        }
+
+        const_iterator begin() const noexcept {
+            return data_;
+        }
+
+        iterator end() noexcept {
+            return data_ + size_;
+        }
+
+        const_iterator end() const noexcept {
+            return data_ + size_;
+        }
+
+        value_type *data() noexcept {
+            return data_;
+        }
+
+        const value_type *data() const noexcept {
+            return data_;
+        }
+
+        size_type size() const noexcept {
+            return size_;
+        }
+
+        size_type capacity() const noexcept {
+            return capacity_;
+        }
+
+        static constexpr size_type max_size() noexcept {
+            return static_cast<size_type>(-1) / sizeof(value_type);
+        }
+
+        bool empty() const noexcept {
+            return size_ == 0;
+        }
+
+        bool is_inline() const noexcept {
+            return data_ == inline_data();
+        }
+
+        reference operator[](size_type index) noexcept {
+            return data_[index];
+        }
+
+        const_reference operator[](size_type index) const noexcept {
+            return data_[index];
+        }
+
+        reference at(size_type index) {
+            if (index >= size_) {
+                throw std::out_of_range("intrusive_vector::at");
+            }
+            return data_[index];
+        }
+
+        reference front() noexcept {
+            return data_[0];
+        }
+
+        reference back() noexcept {
+            return data_[size_ - 1];
+        }
+
+        void reserve(size_type capacity) {
+            if (capacity <= capacity_) {
+                return;
+            }
+            if (capacity > max_size()) {
+                throw std::length_error("intrusive_vector::reserve");
+            }
+            void *storage;
+            if (is_inline()) {
+                storage = std::malloc(capacity * sizeof(value_type));
+                if (storage && size_) {
+                    std::memcpy(storage, static_cast<void *>(data_), size_ * sizeof(value_type));
+                }
+            } else {
+                storage = std::realloc(static_cast<void *>(data_), capacity * sizeof(value_type));
+            }
+            if (!storage) {
+                throw std::bad_alloc();
+            }
+            data_ = static_cast<value_type *>(storage);
+            capacity_ = capacity;
+        }
+
+        void push_back(const value_type &value) {
+            emplace_back(value);
+        }
+
+        void push_back(value_type &&value) {
+            emplace_back(std::move(value));
+        }
+
+        template <class... Args>
+        reference emplace_back(Args &&... args) {
+            value_type value(std::forward<Args>(args)...);
+            grow_for(1);
+            ::new (static_cast<void *>(data_ + size_)) value_type(std::move(value));
+            return data_[size_++];
+        }
+
+        void pop_back() noexcept {
+            data_[--size_].~value_type();
+        }
+
+        iterator insert(const_iterator pos, value_type value) {
+            auto index = static_cast<size_type>(pos - data_);
+            grow_for(1);
+            std::memmove(static_cast<void *>(data_ + index + 1), static_cast<void *>(data_ + index),
+                         (size_ - index) * sizeof(value_type));
+            ::new (static_cast<void *>(data_ + index)) value_type(std::move(value));
+            ++size_;
+            return data_ + index;
+        }
+
+        iterator erase(const_iterator pos) noexcept {
+            return erase(pos, pos + 1);
+        }
+
+        iterator erase(const_iterator first, const_iterator last) noexcept {
+            auto from = static_cast<size_type>(first - data_);
+            auto to = static_cast<size_type>(last - data_);
+            for (auto i = from; i < to; ++i) {
+                data_[i].~value_type();
+            }
+            std::memmove(static_cast<void *>(data_ + from), static_cast<void *>(data_ + to),
+                         (size_ - to) * sizeof(value_type));
+            size_ -= to - from;
+            return data_ + from;
+        }
+
+        // Removes the element at pos by moving the last element into its
+        // place; one relocation instead of shifting the tail.
+        void erase_unordered(const_iterator pos) noexcept {
+            auto index = static_cast<size_type>(pos - data_);
+            data_[index].~value_type();
+            if (index != --size_) {
+                std::memcpy(static_cast<void *>(data_ + index), static_cast<void *>(data_ + size_), sizeof(value_type));
+            }
+        }
+
+        void clear() noexcept {
+            while (size_) {
+                pop_back();
+            }
+        }
+
+        // Sorts the stored raw pointers in place; comp receives the elements
+        // as intrusive_ptr and defaults to pointer order.
+        template <class Compare>
+        void sort(Compare comp) {
+            auto raw = reinterpret_cast<T **>(data_);
+            std::sort(raw, raw + size_, [&comp](T *const &lhs, T *const &rhs) {
+                return comp(reinterpret_cast<const value_type &>(lhs), reinterpret_cast<const value_type &>(rhs));
+            });
+        }
+
+        void sort() {
+            auto raw = reinterpret_cast<T **>(data_);
+            std::sort(raw, raw + size_, std::less<T *>());
+        }
+
+        void swap(intrusive_vector &other) noexcept {
+            if (!is_inline() && !other.is_inline()) {
+                std::swap(data_, other.data_);
+                std::swap(size_, other.size_);
+                std::swap(capacity_, other.capacity_);
+                return;
+            }
+            intrusive_vector tmp(std::move(other));
+            other.steal(*this);
+            steal(tmp);
+        }
+
+    private:
+        value_type *inline_data() noexcept {
+            return reinterpret_cast<value_type *>(inline_);
+        }
+
+        const value_type *inline_data() const noexcept {
+            return reinterpret_cast<const value_type *>(inline_);
+        }
+
+        void grow_for(size_type extra) {
+            if (size_ + extra > capacity_) {
+                auto doubled = capacity_ > max_size() / 2 ? max_size() : capacity_ * 2;
+                reserve(std::max(doubled, size_ + extra));
+            }
+        }
+
+        void release_storage() noexcept {
+            if (!is_inline()) {
+                std::free(static_cast<void *>(data_));
+            }
+        }
+
+        // Takes over the elements of other, which must be empty afterwards;
+        // this must be empty and inline on entry.
+        void steal(intrusive_vector &other) noexcept {
+            if (other.is_inline()) {
+                std::memcpy(static_cast<void *>(data_), static_cast<void *>(other.data_),
+                            other.size_ * sizeof(value_type));
+            } else {
+                data_ = other.data_;
+                capacity_ = other.capacity_;
+                other.data_ = other.inline_data();
+                other.capacity_ = InlineCapacity;
+            }
+            size_ = other.size_;
+            other.size_ = 0;
+        }
+
+        value_type *data_;
+        size_type size_;
+        size_type capacity_;
+        alignas(value_type) unsigned char inline_[InlineCapacity * sizeof(value_type)];
+    };
+
+    template <class T, size_t N>
+    inline void swap(intrusive_vector<T, N> &a, intrusive_vector<T, N> &b) noexcept {
+        a.swap(b);
+    }
+
+}
+
+#endif // INTRUSIVE_VECTOR_HPP
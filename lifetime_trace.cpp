@@ -0,0 +1,171 @@
+#include "lifetime_trace.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define INTRUSIVE_PTR_TRACE_TSC 1
+#endif
+
+namespace std {
+
+    constexpr unsigned lifetime_event::kind_shift;
+    constexpr uint32_t lifetime_event::count_mask;
+
+    namespace {
+
+        constexpr size_t ring_mask = lifetime_trace_ring_capacity - 1;
+
+        // Single producer (the attached thread), single consumer (the
+        // drainer, serialized by drain_mutex). Rings are never freed: an
+        // exiting thread returns its ring to the pool with any undrained
+        // events, and the next new thread appends after them.
+        struct trace_ring {
+            std::atomic<uint64_t> head{0};
+            std::atomic<uint64_t> tail{0};
+            std::atomic<bool> in_use{true};
+            trace_ring *next = nullptr;
+            lifetime_event events[lifetime_trace_ring_capacity];
+        };
+
+        std::atomic<trace_ring *> rings{nullptr};
+        std::atomic<uint32_t> next_thread{0};
+        std::atomic<uint64_t> dropped{0};
+
+        std::mutex &drain_mutex() {
+            static std::mutex mtx;
+            return mtx;
+        }
+
+        inline uint64_t timestamp() noexcept {
+#ifdef INTRUSIVE_PTR_TRACE_TSC
+            return __rdtsc();
+#else
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+        }
+
+        trace_ring *acquire_ring() {
+            for (auto ring = rings.load(std::memory_order_acquire); ring; ring = ring->next) {
+                bool expected = false;
+                if (ring->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                    return ring;
+                }
+            }
+            auto ring = new trace_ring;
+            auto head = rings.load(std::memory_order_relaxed);
+            do {
+                ring->next = head;
+            } while (!rings.compare_exchange_weak(head, ring, std::memory_order_release, std::memory_order_relaxed));
+            return ring;
+        }
+
+        struct thread_attachment {
+            trace_ring *ring = nullptr;
+            uint32_t thread = 0;
+            bool exited = false;
+
+            ~thread_attachment() {
+                if (ring) {
+                    ring->in_use.store(false, std::memory_order_release);
+                }
+                // events from later thread-local destructors are dropped
+                ring = nullptr;
+                exited = true;
+            }
+        };
+
+        thread_attachment *attach_thread() noexcept {
+            static thread_local thread_attachment attachment;
+            if (attachment.exited) {
+                return nullptr;
+            }
+            if (!attachment.ring) {
+                try {
+                    attachment.ring = acquire_ring();
+                } catch (...) {
+                    return nullptr;
+                }
+                attachment.thread = next_thread.fetch_add(1, std::memory_order_relaxed);
+            }
+            return &attachment;
+        }
+
+    }
+
+#if defined(__GNUC__)
+    __attribute__((noinline))
+#endif
+    void trace_lifetime_event(const void *object, lifetime_event_kind kind, size_t count) noexcept {
+        auto attachment = attach_thread();
+        if (!attachment) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        auto ring = attachment->ring;
+        auto head = ring->head.load(std::memory_order_relaxed);
+        if (head - ring->tail.load(std::memory_order_acquire) == lifetime_trace_ring_capacity) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        auto &event = ring->events[head & ring_mask];
+        event.timestamp = timestamp();
+        event.object = reinterpret_cast<uintptr_t>(object);
+#if defined(__GNUC__)
+        event.caller = reinterpret_cast<uintptr_t>(__builtin_extract_return_addr(__builtin_return_address(0)));
+#else
+        event.caller = 0;
+#endif
+        event.thread = attachment->thread;
+        auto clamped = count > lifetime_event::count_mask ? lifetime_event::count_mask : count;
+        event.kind_count = (static_cast<uint32_t>(kind) << lifetime_event::kind_shift) |
+                           static_cast<uint32_t>(clamped);
+        ring->head.store(head + 1, std::memory_order_release);
+    }
+
+    bool begin_lifetime_trace(std::FILE *out) noexcept {
+        lifetime_trace_header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "IPTRACE", 8);
+        header.version = 1;
+        header.event_size = sizeof(lifetime_event);
+#ifdef INTRUSIVE_PTR_TRACE_TSC
+        header.clock = 1;
+#endif
+        return std::fwrite(&header, sizeof(header), 1, out) == 1;
+    }
+
+    size_t drain_lifetime_trace(std::FILE *out) noexcept {
+        std::lock_guard<std::mutex> lock(drain_mutex());
+        size_t written = 0;
+        for (auto ring = rings.load(std::memory_order_acquire); ring; ring = ring->next) {
+            auto tail = ring->tail.load(std::memory_order_relaxed);
+            auto head = ring->head.load(std::memory_order_acquire);
+            while (tail != head) {
+                // up to the end of the buffer, then wrap
+                auto first = tail & ring_mask;
+                auto count = static_cast<size_t>(head - tail);
+                if (count > lifetime_trace_ring_capacity - first) {
+                    count = lifetime_trace_ring_capacity - first;
+                }
+                auto done = std::fwrite(&ring->events[first], sizeof(lifetime_event), count, out);
+                tail += done;
+                written += done;
+                ring->tail.store(tail, std::memory_order_release);
+                if (done != count) {
+                    return written;
+                }
+            }
+        }
+        return written;
+    }
+
+    uint64_t lifetime_trace_dropped() noexcept {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+} //
@@ -0,0 +1,117 @@
+#ifndef LIFETIME_TRACE_HPP
+#define LIFETIME_TRACE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include "ref_counted.hpp"
+
+
+namespace std {
+
+    // Refcount lifetime tracing for selected types.
+    //
+    // Every count change of an object whose counter policy is wrapped in
+    // traced_ref_count is written as one lifetime_event into a per-thread
+    // single-producer ring; no lock is taken on the traced path. A full ring
+    // drops the event and counts it. drain_lifetime_trace() moves the rings
+    // into a binary file that tools/lifetime_trace_dump turns back into
+    // per-object ref histories.
+    //
+    // File layout: one lifetime_trace_header, then lifetime_events in drain
+    // order; events of one thread are in program order.
+
+    enum class lifetime_event_kind : uint32_t {
+        created = 0,  // count is the initial count
+        add_ref = 1,
+        release = 2,
+    };
+
+    struct lifetime_event {
+        // rdtsc on x86, steady_clock nanoseconds elsewhere; see the header
+        uint64_t timestamp;
+        uint64_t object;
+        // return address of the traced call, inside the function that
+        // copied or dropped the pointer; 0 where unavailable
+        uint64_t caller;
+        // small per-thread id, assigned in order of first traced event
+        uint32_t thread;
+        // kind in the top two bits, count in the rest
+        uint32_t kind_count;
+
+        static constexpr unsigned kind_shift = 30;
+        static constexpr uint32_t count_mask = (uint32_t{1} << kind_shift) - 1;
+
+        inline lifetime_event_kind kind() const noexcept {
+            return static_cast<lifetime_event_kind>(kind_count >> kind_shift);
+        }
+
+        inline uint32_t count() const noexcept {
+            return kind_count & count_mask;
+        }
+    };
+
+    static_assert(sizeof(lifetime_event) == 32, "lifetime_event is part of the file format");
+
+    struct lifetime_trace_header {
+        char magic[8];       // "IPTRACE\0"
+        uint32_t version;    // 1
+        uint32_t event_size; // sizeof(lifetime_event)
+        uint32_t clock;      // 0: steady_clock nanoseconds, 1: TSC ticks
+        uint32_t reserved;
+    };
+
+    constexpr size_t lifetime_trace_ring_capacity = size_t{1} << 16;
+
+    // Records one event for object on the calling thread's ring.
+    void trace_lifetime_event(const void *object, lifetime_event_kind kind, size_t count) noexcept;
+
+    // Writes the file header; call once before the first drain.
+    bool begin_lifetime_trace(std::FILE *out) noexcept;
+
+    // Appends every buffered event of every thread to out and returns the
+    // number of events written. Drains may run concurrently with tracing
+    // threads; concurrent drains are serialized.
+    size_t drain_lifetime_trace(std::FILE *out) noexcept;
+
+    // Events lost to full rings since the program started.
+    uint64_t lifetime_trace_dropped() noexcept;
+
+    // Counter policy wrapper that traces every count change of the wrapped
+    // policy, for example ref_counted_base<node, traced_ref_count<>>.
+    // Destruction is not traced separately: it is the release that brings
+    // the count to zero.
+    template <class CounterPolicy = atomic_ref_count>
+    class traced_ref_count {
+    public:
+        explicit traced_ref_count(size_t initial) noexcept : rc_(initial), object_(nullptr) {}
+
+        inline void bind(void *object, void (*reclaim)(void *)) noexcept {
+            object_ = object;
+            rc_.bind(object, reclaim);
+            trace_lifetime_event(object, lifetime_event_kind::created, rc_.load());
+        }
+
+        inline void increment(size_t n = 1) noexcept {
+            trace_lifetime_event(object_, lifetime_event_kind::add_ref, n);
+            rc_.increment(n);
+        }
+
+        inline bool decrement(size_t n = 1) noexcept {
+            trace_lifetime_event(object_, lifetime_event_kind::release, n);
+            return rc_.decrement(n);
+        }
+
+        inline size_t load() const noexcept {
+            return rc_.load();
+        }
+
+    private:
+        CounterPolicy rc_;
+        const void *object_;
+    };
+
+}
+
+#endif // LIFETIME_TRACE_HPP
@@ -0,0 +1,122 @@
+#include "mapped_graph.hpp"
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace std {
+
+    namespace {
+
+        // Every later bound check relies on these, so a truncated or
+        // corrupt file must fail here rather than wrap an offset.
+        bool valid_header(const mapped_graph_header &header, size_t file_size, uint64_t schema) noexcept {
+            return std::memcmp(header.magic, "IPGRAPH", 8) == 0 && header.version == 1 &&
+                   header.pointer_size == sizeof(void *) && header.byte_order == mapped_graph_byte_order &&
+                   header.schema == schema && header.image_size >= sizeof(mapped_graph_header) &&
+                   header.image_size <= file_size && header.image_size % sizeof(uint64_t) == 0 &&
+                   header.reloc_offset == header.image_size &&
+                   header.reloc_count <= (file_size - header.reloc_offset) / sizeof(uint64_t) &&
+                   (header.root_offset == 0 ||
+                    (header.root_offset >= sizeof(mapped_graph_header) && header.root_offset < header.image_size &&
+                     header.root_size <= header.image_size - header.root_offset));
+        }
+
+        // Relocations patch pointer fields inside the objects.
+        inline bool valid_reloc(const mapped_graph_header &header, uint64_t offset) noexcept {
+            return offset >= sizeof(mapped_graph_header) && offset % sizeof(uintptr_t) == 0 &&
+                   offset <= header.image_size - sizeof(uintptr_t);
+        }
+
+        void *map_file(int fd, size_t size, uint64_t preferred_base) noexcept {
+            auto hint = reinterpret_cast<void *>(static_cast<uintptr_t>(preferred_base));
+            int flags = MAP_PRIVATE;
+#ifdef MAP_FIXED_NOREPLACE
+            // kernels without it treat it as a plain hint
+            flags |= MAP_FIXED_NOREPLACE;
+#endif
+            auto addr = mmap(hint, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+            if (addr == MAP_FAILED) {
+                addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            }
+            return addr == MAP_FAILED ? nullptr : addr;
+        }
+
+    }
+
+    mapped_graph::mapped_graph() noexcept
+            : base_(nullptr), size_(0), root_offset_(0), root_size_(0), relocated_(false) {
+        // nop
+    }
+
+    mapped_graph::~mapped_graph() {
+        close();
+    }
+
+    bool mapped_graph::open(const char *path, uint64_t schema) noexcept {
+        close();
+        int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            auto error = errno;
+            ::close(fd);
+            errno = error;
+            return false;
+        }
+        auto file_size = static_cast<size_t>(st.st_size);
+        mapped_graph_header header;
+        if (file_size < sizeof(header) || pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+            !valid_header(header, file_size, schema)) {
+            ::close(fd);
+            errno = EINVAL;
+            return false;
+        }
+        auto addr = map_file(fd, file_size, header.preferred_base);
+        auto error = errno;
+        ::close(fd);
+        if (!addr) {
+            errno = error;
+            return false;
+        }
+        auto bytes = static_cast<unsigned char *>(addr);
+        auto delta = static_cast<uintptr_t>(reinterpret_cast<uintptr_t>(addr) - header.preferred_base);
+        if (delta) {
+            auto relocs = reinterpret_cast<const uint64_t *>(bytes + header.reloc_offset);
+            for (uint64_t i = 0; i < header.reloc_count; ++i) {
+                if (!valid_reloc(header, relocs[i])) {
+                    munmap(addr, file_size);
+                    errno = EINVAL;
+                    return false;
+                }
+                uintptr_t value;
+                std::memcpy(&value, bytes + relocs[i], sizeof(value));
+                value += delta;
+                std::memcpy(bytes + relocs[i], &value, sizeof(value));
+            }
+        }
+        base_ = addr;
+        size_ = file_size;
+        root_offset_ = header.root_offset;
+        root_size_ = header.root_size;
+        relocated_ = delta != 0;
+        return true;
+    }
+
+    void mapped_graph::close() noexcept {
+        if (base_) {
+            munmap(base_, size_);
+        }
+        base_ = nullptr;
+        size_ = 0;
+        root_offset_ = 0;
+        root_size_ = 0;
+        relocated_ = false;
+    }
+
+} //
@@ -0,0 +1,235 @@
+#ifndef MAPPED_GRAPH_HPP
+#define MAPPED_GRAPH_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "intrusive_ptr.hpp"
+#include "ref_counted.hpp"
+
+
+namespace std {
+
+    // Snapshots of intrusive_ptr graphs that load by mmap.
+    //
+    // write_mapped_graph() lays every object reachable from a root out in one
+    // image. Each object appears once, so shared nodes stay shared, and every
+    // intrusive_ptr field holds the address its target would have if the file
+    // were mapped at the image's preferred base. A relocation table lists
+    // those fields. mapped_graph maps the file privately: at the preferred
+    // base nothing is written and pages fault in on first touch; anywhere
+    // else only the relocated pointers are patched. Objects are never
+    // constructed or destroyed: their counts are pinned far above zero, so
+    // intrusive_ptr copies work as usual and the last release never comes.
+    //
+    // Mapped types derive from mapped_ref_counted, are not polymorphic, hold
+    // no pointers other than intrusive_ptrs to mapped types, and report each
+    // of those through
+    //
+    //     template <class Visitor> void visit_graph(Visitor &visit) const;
+    //
+    // by calling visit(field). The bytes of everything else are copied as
+    // they are, so the file is only readable by the same build on the same
+    // platform; the schema argument lets callers reject stale files.
+
+    constexpr size_t mapped_pinned_count = size_t{1} << (sizeof(size_t) * 8 - 2);
+
+    constexpr uint64_t mapped_graph_default_base = sizeof(void *) == 8 ? 0x5f0000000000ull : 0x60000000ull;
+
+    template <class Derived, class CounterPolicy = atomic_ref_count>
+    class mapped_ref_counted : public basic_ref_counted<CounterPolicy, Derived> {
+    public:
+        // Offset of the counter inside Derived, where the writer stores the
+        // pinned count.
+        inline size_t mapped_count_offset() const noexcept {
+            static_assert(sizeof(CounterPolicy) == sizeof(size_t), "the counter must be a single size_t");
+            return static_cast<size_t>(reinterpret_cast<const unsigned char *>(&this->rc_) -
+                                       reinterpret_cast<const unsigned char *>(static_cast<const Derived *>(this)));
+        }
+    };
+
+    struct mapped_graph_header {
+        char magic[8];           // "IPGRAPH\0"
+        uint32_t version;        // 1
+        uint32_t pointer_size;   // sizeof(void *)
+        uint64_t byte_order;     // mapped_graph_byte_order as written
+        uint64_t preferred_base;
+        uint64_t schema;
+        uint64_t image_size;     // header and objects; relocations follow
+        uint64_t root_offset;    // 0 for an empty graph
+        uint64_t root_size;      // sizeof the root type
+        uint64_t reloc_offset;
+        uint64_t reloc_count;
+    };
+
+    constexpr uint64_t mapped_graph_byte_order = 0x0102030405060708ull;
+
+    namespace intrusive_detail {
+
+        class mapped_graph_writer {
+        public:
+            explicit mapped_graph_writer(uint64_t base) : base_(base), image_(image_start, 0) {}
+
+            template <class T>
+            uint64_t place(const T *object) {
+                static_assert(!is_polymorphic<T>::value, "mapped types cannot have a vtable");
+                static_assert(is_base_of<mapped_ref_counted<T, typename T::counter_policy>, T>::value,
+                              "mapped types derive from mapped_ref_counted<T>");
+                if (!object) {
+                    return 0;
+                }
+                auto found = offsets_.find(object);
+                if (found != offsets_.end()) {
+                    return found->second;
+                }
+                auto offset = (image_.size() + alignof(T) - 1) / alignof(T) * alignof(T);
+                image_.resize(offset + sizeof(T));
+                std::memcpy(&image_[offset], static_cast<const void *>(object), sizeof(T));
+                size_t pinned = mapped_pinned_count;
+                std::memcpy(&image_[offset + object->mapped_count_offset()], &pinned, sizeof(pinned));
+                offsets_.emplace(object, offset);
+                pending_.push_back({object, offset, &walk<T>});
+                return offset;
+            }
+
+            // Places the fields of every object placed so far, and of the
+            // objects they reach, without recursion.
+            void drain() {
+                while (!pending_.empty()) {
+                    auto item = pending_.back();
+                    pending_.pop_back();
+                    item.walk(*this, item.object, item.offset);
+                }
+            }
+
+            bool write(std::FILE *out, uint64_t root_offset, uint64_t root_size, uint64_t schema) {
+                image_.resize((image_.size() + 7) / 8 * 8);
+                mapped_graph_header header;
+                std::memset(&header, 0, sizeof(header));
+                std::memcpy(header.magic, "IPGRAPH", 8);
+                header.version = 1;
+                header.pointer_size = sizeof(void *);
+                header.byte_order = mapped_graph_byte_order;
+                header.preferred_base = base_;
+                header.schema = schema;
+                header.image_size = image_.size();
+                header.root_offset = root_offset;
+                header.root_size = root_size;
+                header.reloc_offset = image_.size();
+                header.reloc_count = relocs_.size();
+                std::memcpy(&image_[0], &header, sizeof(header));
+                return std::fwrite(image_.data(), 1, image_.size(), out) == image_.size() &&
+                       std::fwrite(relocs_.data(), sizeof(uint64_t), relocs_.size(), out) == relocs_.size();
+            }
+
+        private:
+            static constexpr size_t image_start = (sizeof(mapped_graph_header) + 63) / 64 * 64;
+
+            struct pending_object {
+                const void *object;
+                uint64_t offset;
+                void (*walk)(mapped_graph_writer &, const void *, uint64_t);
+            };
+
+            struct field_visitor {
+                mapped_graph_writer &writer;
+                const unsigned char *object;
+                uint64_t offset;
+
+                template <class U>
+                void operator()(const intrusive_ptr<U> &field) {
+                    static_assert(sizeof(field) == sizeof(uintptr_t), "intrusive_ptr must be a single raw pointer");
+                    auto field_offset = offset + static_cast<uint64_t>(
+                            reinterpret_cast<const unsigned char *>(&field) - object);
+                    auto target = writer.place(field.get());
+                    uintptr_t value = target ? static_cast<uintptr_t>(writer.base_ + target) : 0;
+                    std::memcpy(&writer.image_[field_offset], &value, sizeof(value));
+                    if (target) {
+                        writer.relocs_.push_back(field_offset);
+                    }
+                }
+            };
+
+            template <class T>
+            static void walk(mapped_graph_writer &writer, const void *object, uint64_t offset) {
+                field_visitor visit{writer, static_cast<const unsigned char *>(object), offset};
+                static_cast<const T *>(object)->visit_graph(visit);
+            }
+
+            uint64_t base_;
+            std::vector<unsigned char> image_;
+            std::vector<uint64_t> relocs_;
+            std::vector<pending_object> pending_;
+            std::unordered_map<const void *, uint64_t> offsets_;
+        };
+
+    }
+
+    // Writes the graph reachable from root to out. Returns false on a write
+    // error; the file is then incomplete.
+    template <class T>
+    bool write_mapped_graph(std::FILE *out, const intrusive_ptr<T> &root, uint64_t schema = 0,
+                            uint64_t preferred_base = mapped_graph_default_base) {
+        intrusive_detail::mapped_graph_writer writer(preferred_base);
+        auto root_offset = writer.place(root.get());
+        writer.drain();
+        return writer.write(out, root_offset, sizeof(T), schema);
+    }
+
+    // A graph file mapped into memory. The mapping must outlive every pointer
+    // into it: unmapping does not and cannot check for remaining refs.
+    class mapped_graph {
+    public:
+        mapped_graph() noexcept;
+
+        ~mapped_graph();
+
+        mapped_graph(const mapped_graph &) = delete;
+
+        mapped_graph &operator=(const mapped_graph &) = delete;
+
+        // Maps path and applies relocations if the preferred base is taken.
+        // Returns false and sets errno if the file cannot be mapped, or
+        // EINVAL if it is not a graph for this platform and schema.
+        bool open(const char *path, uint64_t schema = 0) noexcept;
+
+        void close() noexcept;
+
+        inline bool is_open() const noexcept {
+            return base_ != nullptr;
+        }
+
+        // True if the mapping missed the preferred base and pointers were
+        // patched.
+        inline bool relocated() const noexcept {
+            return relocated_;
+        }
+
+        inline size_t size() const noexcept {
+            return size_;
+        }
+
+        template <class T>
+        intrusive_ptr<T> root() const noexcept {
+            assert((!root_offset_ || root_size_ == sizeof(T)) && "root type does not match the file");
+            return intrusive_ptr<T>(root_offset_ ? reinterpret_cast<T *>(static_cast<unsigned char *>(base_) +
+                                                                         root_offset_) : nullptr);
+        }
+
+    private:
+        void *base_;
+        size_t size_;
+        uint64_t root_offset_;
+        uint64_t root_size_;
+        bool relocated_;
+    };
+
+}
+
+#endif // MAPPED_GRAPH_HPP
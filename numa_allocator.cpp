@@ -0,0 +1,177 @@
+#include "numa_allocator.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace std {
+
+    namespace {
+
+        constexpr size_t chunk_size = 64 * 1024;
+        constexpr size_t min_block_shift = 4;
+        constexpr size_t class_count = 10; // 16 .. 8192, as in slab_allocator
+        constexpr size_t large_class = class_count;
+        constexpr size_t large_offset = 64;
+        constexpr size_t max_nodes = 1024;
+
+        struct chunk_header {
+            size_t node;
+            size_t size_class;
+        };
+
+        struct free_block {
+            free_block *next;
+        };
+
+        struct node_heap {
+            std::mutex mtx;
+            free_block *free_list[class_count] = {};
+            unsigned char *bump[class_count] = {};
+            unsigned char *bump_end[class_count] = {};
+        };
+
+        inline size_t block_size(size_t size_class) {
+            return size_t{1} << (min_block_shift + size_class);
+        }
+
+        inline size_t size_class_of(size_t size) {
+            size_t size_class = 0;
+            while (block_size(size_class) < size) {
+                ++size_class;
+            }
+            return size_class;
+        }
+
+        inline chunk_header *chunk_of(void *ptr) {
+            return reinterpret_cast<chunk_header *>(reinterpret_cast<uintptr_t>(ptr) & ~(chunk_size - 1));
+        }
+
+        size_t read_node_count() noexcept {
+            // "0" or "0-3"; the last number is the highest possible node
+            auto in = std::fopen("/sys/devices/system/node/possible", "r");
+            if (!in) {
+                return 1;
+            }
+            size_t last = 0;
+            unsigned long value = 0;
+            int c;
+            while ((c = std::fgetc(in)) != EOF) {
+                if (c >= '0' && c <= '9') {
+                    value = value * 10 + static_cast<unsigned long>(c - '0');
+                } else {
+                    last = value;
+                    value = 0;
+                }
+            }
+            std::fclose(in);
+            if (value) {
+                last = value;
+            }
+            return last + 1 < max_nodes ? last + 1 : max_nodes;
+        }
+
+        // Best effort: on failure the pages stay wherever first touch puts
+        // them.
+        void bind_to_node(void *ptr, size_t size, size_t node) noexcept {
+#if defined(__linux__) && defined(SYS_mbind)
+            constexpr long mpol_preferred = 1;
+            constexpr unsigned long mpol_mf_move = 1 << 1;
+            constexpr size_t bits = sizeof(unsigned long) * 8;
+            unsigned long mask[max_nodes / bits] = {};
+            mask[node / bits] = 1ul << (node % bits);
+            syscall(SYS_mbind, ptr, size, mpol_preferred, mask, max_nodes + 1, mpol_mf_move);
+#else
+            (void) ptr;
+            (void) size;
+            (void) node;
+#endif
+        }
+
+        void *allocate_chunk(size_t size, size_t node) {
+            void *ptr = nullptr;
+            if (posix_memalign(&ptr, chunk_size, size) != 0) {
+                throw std::bad_alloc();
+            }
+            bind_to_node(ptr, size, node);
+            return ptr;
+        }
+
+        node_heap &heap_of(size_t node) {
+            static node_heap *heaps = new node_heap[numa_node_count()]; // outlives static destructors
+            return heaps[node];
+        }
+
+    }
+
+    size_t numa_node_count() noexcept {
+        static const size_t count = read_node_count();
+        return count;
+    }
+
+    size_t current_numa_node() noexcept {
+#if defined(__linux__) && defined(SYS_getcpu)
+        unsigned cpu = 0;
+        unsigned node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0 && node < numa_node_count()) {
+            return node;
+        }
+#endif
+        return 0;
+    }
+
+    void *numa_allocate(size_t size, size_t node) {
+        if (node >= numa_node_count()) {
+            node %= numa_node_count();
+        }
+        if (size > block_size(class_count - 1)) {
+            auto chunk = static_cast<chunk_header *>(allocate_chunk(
+                    (size + large_offset + chunk_size - 1) / chunk_size * chunk_size, node));
+            chunk->node = node;
+            chunk->size_class = large_class;
+            return reinterpret_cast<unsigned char *>(chunk) + large_offset;
+        }
+        auto size_class = size_class_of(size);
+        auto &heap = heap_of(node);
+        std::lock_guard<std::mutex> guard(heap.mtx);
+        if (auto block = heap.free_list[size_class]) {
+            heap.free_list[size_class] = block->next;
+            return block;
+        }
+        if (heap.bump[size_class] == heap.bump_end[size_class]) {
+            auto chunk = static_cast<chunk_header *>(allocate_chunk(chunk_size, node));
+            chunk->node = node;
+            chunk->size_class = size_class;
+            auto base = reinterpret_cast<unsigned char *>(chunk);
+            auto block = block_size(size_class);
+            heap.bump[size_class] = base + (sizeof(chunk_header) + block - 1) / block * block;
+            heap.bump_end[size_class] = base + chunk_size;
+        }
+        auto result = heap.bump[size_class];
+        heap.bump[size_class] += block_size(size_class);
+        return result;
+    }
+
+    void numa_deallocate(void *ptr) noexcept {
+        if (!ptr) {
+            return;
+        }
+        auto chunk = chunk_of(ptr);
+        if (chunk->size_class == large_class) {
+            free(chunk);
+            return;
+        }
+        auto block = static_cast<free_block *>(ptr);
+        auto &heap = heap_of(chunk->node);
+        std::lock_guard<std::mutex> guard(heap.mtx);
+        block->next = heap.free_list[chunk->size_class];
+        heap.free_list[chunk->size_class] = block;
+    }
+
+} //
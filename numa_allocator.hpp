@@ -0,0 +1,117 @@
+#ifndef NUMA_ALLOCATOR_HPP
+#define NUMA_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+#include "allocate_intrusive.hpp"
+#include "sharded_ref_count.hpp"
+
+
+namespace std {
+
+    // NUMA placement for ref counted objects.
+    //
+    // numa_allocate() carves blocks from 64 KiB chunks whose pages are bound
+    // to one node (mbind with MPOL_PREFERRED, so a full node falls back to
+    // its neighbours instead of failing). Each node has one heap with a
+    // size-class free list behind a mutex; any thread may free any block.
+    // Without kernel NUMA support every node id maps to ordinary memory.
+
+    // Number of possible nodes; 1 on machines or kernels without NUMA.
+    size_t numa_node_count() noexcept;
+
+    // Node of the CPU the calling thread is running on right now.
+    size_t current_numa_node() noexcept;
+
+    void *numa_allocate(size_t size, size_t node);
+
+    void numa_deallocate(void *ptr) noexcept;
+
+    // Tag for the placing make_intrusive overload.
+    struct numa_node {
+        size_t id;
+
+        explicit numa_node(size_t node) noexcept : id(node) {}
+    };
+
+    template <class T>
+    class numa_allocator {
+    public:
+        using value_type = T;
+
+        explicit numa_allocator(size_t node) noexcept : node_(node) {}
+
+        template <class U>
+        numa_allocator(const numa_allocator<U> &other) noexcept : node_(other.node()) {}
+
+        T *allocate(size_t n) {
+            return static_cast<T *>(numa_allocate(n * sizeof(T), node_));
+        }
+
+        void deallocate(T *ptr, size_t) noexcept {
+            numa_deallocate(ptr);
+        }
+
+        inline size_t node() const noexcept {
+            return node_;
+        }
+
+    private:
+        size_t node_;
+    };
+
+    // Any numa_allocator can free memory from any node.
+    template <class T, class U>
+    inline bool operator==(const numa_allocator<T> &, const numa_allocator<U> &) noexcept {
+        return true;
+    }
+
+    template <class T, class U>
+    inline bool operator!=(const numa_allocator<T> &, const numa_allocator<U> &) noexcept {
+        return false;
+    }
+
+    // Creates an allocated_ref_counted T on the given node. The object stays
+    // there for its lifetime; the last deref() returns the memory to the
+    // node heap.
+    template <class T, class... Args>
+    inline intrusive_ptr<T> make_intrusive(numa_node node, Args &&... args) {
+        static_assert(uses_intrusive_allocator<T>::value,
+                      "placing make_intrusive needs T to derive from allocated_ref_counted<T>");
+        return allocate_intrusive<T>(numa_allocator<T>(node.id), std::forward<Args>(args)...);
+    }
+
+    // Shard selector for sharded_ref_count that gives each node its own
+    // replica. The node is re-read every refresh_interval calls, so threads
+    // the scheduler migrates follow their new node; a stale node only costs
+    // a remote cache line, never a wrong count.
+    struct numa_node_selector {
+        static constexpr unsigned refresh_interval = 4096;
+
+        static inline size_t index() noexcept {
+            struct cached_node {
+                size_t node = 0;
+                unsigned calls = 0;
+            };
+            static thread_local cached_node cache;
+            if (cache.calls-- == 0) {
+                cache.node = current_numa_node();
+                cache.calls = refresh_interval - 1;
+            }
+            return cache.node;
+        }
+    };
+
+    // Per-node replica mode of sharded_ref_counted: while the object is
+    // published, ref() and deref() touch only the replica of the caller's
+    // node, whose cache line stays in that socket. kill() folds the replicas
+    // into the central counter, which then detects zero as usual. Nodes
+    // beyond MaxNodes share replicas modulo MaxNodes.
+    template <class Derived = void, size_t MaxNodes = 8>
+    using numa_ref_counted = sharded_ref_counted<Derived, MaxNodes, numa_node_selector>;
+
+}
+
+#endif // NUMA_ALLOCATOR_HPP
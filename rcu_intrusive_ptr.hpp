@@ -0,0 +1,105 @@
+#ifndef RCU_INTRUSIVE_PTR_HPP
+#define RCU_INTRUSIVE_PTR_HPP
+
+#include <atomic>
+
+#include "epoch_reclaim.hpp"
+#include "intrusive_ptr.hpp"
+
+
+namespace std {
+
+    // Read-mostly published intrusive_ptr.
+    //
+    // Readers enter an epoch and use the raw pointer without touching the
+    // reference count. A writer swaps in a new object and retires the ref the
+    // slot held on the old one; that ref is dropped only after every reader
+    // that might still use the old object has left its epoch. Works with any
+    // type intrusive_ptr works with.
+    template <class T>
+    class rcu_intrusive_ptr {
+    public:
+        // Raw access to the value published when the guard was taken.
+        class read_guard {
+        public:
+            explicit read_guard(const rcu_intrusive_ptr &src) : ptr_(src.ptr_.load()) {}
+
+            T *get() const noexcept {
+                return ptr_;
+            }
+
+            T *operator->() const noexcept {
+                return ptr_;
+            }
+
+            T &operator*() const noexcept {
+                return *ptr_;
+            }
+
+            explicit operator bool() const noexcept {
+                return ptr_ != nullptr;
+            }
+
+        private:
+            // entered before ptr_ is loaded
+            epoch_guard epoch_;
+            T *ptr_;
+        };
+
+        constexpr rcu_intrusive_ptr() noexcept : ptr_(nullptr) {}
+
+        rcu_intrusive_ptr(intrusive_ptr<T> value) noexcept : ptr_(value.detach()) {}
+
+        rcu_intrusive_ptr(const rcu_intrusive_ptr &) = delete;
+
+        rcu_intrusive_ptr &operator=(const rcu_intrusive_ptr &) = delete;
+
+        ~rcu_intrusive_ptr() {
+            retire(ptr_.load(std::memory_order_relaxed));
+        }
+
+        // Raw pointer for callers that already hold an epoch_guard.
+        T *get_unsafe() const noexcept {
+            return ptr_.load();
+        }
+
+        // Strong ref for values that must outlive the read-side section.
+        intrusive_ptr<T> load() const {
+            epoch_guard guard;
+            return intrusive_ptr<T>(ptr_.load());
+        }
+
+        void store(intrusive_ptr<T> value) {
+            retire(ptr_.exchange(value.detach()));
+        }
+
+        intrusive_ptr<T> exchange(intrusive_ptr<T> value) {
+            auto old = ptr_.exchange(value.detach());
+            intrusive_ptr<T> result(old);
+            retire(old);
+            return result;
+        }
+
+        // Waits until the refs retired by this thread's stores are dropped.
+        void synchronize() {
+            epoch_synchronize();
+        }
+
+    private:
+        static void release(void *ptr) {
+            intrusive_ptr_release(static_cast<T *>(ptr));
+        }
+
+        static void retire(T *ptr) {
+            if (ptr) {
+                epoch_retire(ptr, &release);
+                epoch_reclaim();
+            }
+        }
+
+        std::atomic<T *> ptr_;
+    };
+
+}
+
+#endif // RCU_INTRUSIVE_PTR_HPP
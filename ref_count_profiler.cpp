@@ -0,0 +1,240 @@
+#include "ref_count_profiler.hpp"
+
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#if defined(__GNUC__)
+#include <cxxabi.h>
+#endif
+
+#if defined(__has_include)
+#if __has_include(<execinfo.h>)
+#include <execinfo.h>
+#define INTRUSIVE_PTR_HAS_BACKTRACE 1
+#endif
+#endif
+
+namespace std {
+
+    namespace {
+
+        constexpr int max_frames = 16;
+
+        std::atomic<intrusive_detail::ref_count_type_record *> &type_records() {
+            static std::atomic<intrusive_detail::ref_count_type_record *> head{nullptr};
+            return head;
+        }
+
+        std::atomic<unsigned> sample_rate{1024};
+
+        struct sample {
+            const std::type_info *type;
+            std::chrono::steady_clock::time_point created;
+            void *frames[max_frames];
+            int depth;
+        };
+
+        struct sample_table {
+            std::mutex mtx;
+            std::unordered_map<const void *, sample> live;
+        };
+
+        sample_table &samples() {
+            static sample_table *table = new sample_table; // outlives static destructors
+            return *table;
+        }
+
+        std::string type_name_of(const std::type_info &type) {
+#if defined(__GNUC__)
+            int status = 0;
+            std::unique_ptr<char, void (*)(void *)> demangled(
+                    abi::__cxa_demangle(type.name(), nullptr, nullptr, &status), &std::free);
+            if (status == 0 && demangled) {
+                return demangled.get();
+            }
+#endif
+            return type.name();
+        }
+
+        std::vector<std::string> symbolize(void *const *frames, int depth) {
+            std::vector<std::string> result;
+#ifdef INTRUSIVE_PTR_HAS_BACKTRACE
+            std::unique_ptr<char *, void (*)(void *)> symbols(backtrace_symbols(frames, depth), &std::free);
+            if (symbols) {
+                for (int i = 0; i < depth; ++i) {
+                    result.emplace_back(symbols.get()[i]);
+                }
+            }
+#else
+            (void) frames;
+            (void) depth;
+#endif
+            return result;
+        }
+
+        // Prometheus label values escape backslash, quote and newline.
+        std::string escape_label(const std::string &value) {
+            std::string result;
+            for (auto c : value) {
+                if (c == '\\' || c == '"') {
+                    result += '\\';
+                    result += c;
+                } else if (c == '\n') {
+                    result += "\\n";
+                } else {
+                    result += c;
+                }
+            }
+            return result;
+        }
+
+    }
+
+    namespace intrusive_detail {
+
+        ref_count_type_record::ref_count_type_record(const std::type_info &t) noexcept : type(t) {
+            auto &head = type_records();
+            next = head.load(std::memory_order_relaxed);
+            while (!head.compare_exchange_weak(next, this, std::memory_order_release, std::memory_order_relaxed)) {
+                // retry with the updated head
+            }
+        }
+
+        void ref_count_note_created(ref_count_type_record &record, ref_count_probe &probe,
+                                    const void *object) noexcept {
+            record.created.fetch_add(1, std::memory_order_relaxed);
+            auto live = record.live.fetch_add(1, std::memory_order_relaxed) + 1;
+            auto peak = record.peak.load(std::memory_order_relaxed);
+            while (peak < live && !record.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+                // retry with the updated peak
+            }
+            probe.creator = ref_count_thread_token();
+            probe.sampled = false;
+
+            static thread_local unsigned countdown = 0;
+            auto rate = sample_rate.load(std::memory_order_relaxed);
+            if (rate == 0 || ++countdown < rate) {
+                return;
+            }
+            countdown = 0;
+            sample entry;
+            entry.type = &record.type;
+            entry.created = std::chrono::steady_clock::now();
+#ifdef INTRUSIVE_PTR_HAS_BACKTRACE
+            entry.depth = backtrace(entry.frames, max_frames);
+#else
+            entry.depth = 0;
+#endif
+            auto &table = samples();
+            try {
+                std::lock_guard<std::mutex> lock(table.mtx);
+                table.live[object] = entry;
+                probe.sampled = true;
+            } catch (...) {
+                // out of memory; skip this sample
+            }
+        }
+
+        void ref_count_note_destroyed(ref_count_type_record &record, const ref_count_probe &probe,
+                                      const void *object) noexcept {
+            record.destroyed.fetch_add(1, std::memory_order_relaxed);
+            record.live.fetch_sub(1, std::memory_order_relaxed);
+            if (probe.sampled) {
+                auto &table = samples();
+                std::lock_guard<std::mutex> lock(table.mtx);
+                table.live.erase(object);
+            }
+        }
+
+    }
+
+    std::vector<ref_count_stats> ref_count_snapshot() {
+        std::vector<ref_count_stats> result;
+        for (auto record = type_records().load(std::memory_order_acquire); record; record = record->next) {
+            ref_count_stats stats;
+            stats.type_name = type_name_of(record->type);
+            stats.live = record->live.load(std::memory_order_relaxed);
+            stats.peak = record->peak.load(std::memory_order_relaxed);
+            stats.created = record->created.load(std::memory_order_relaxed);
+            stats.destroyed = record->destroyed.load(std::memory_order_relaxed);
+            stats.add_refs = record->add_refs.load(std::memory_order_relaxed);
+            stats.releases = record->releases.load(std::memory_order_relaxed);
+            stats.cross_thread_releases = record->cross_thread_releases.load(std::memory_order_relaxed);
+            result.push_back(std::move(stats));
+        }
+        return result;
+    }
+
+    std::string ref_count_prometheus() {
+        struct metric {
+            const char *name;
+            const char *type;
+            const char *help;
+            uint64_t ref_count_stats::*value;
+        };
+        static const metric metrics[] = {
+                {"intrusive_ptr_live_objects", "gauge", "Objects currently alive.", &ref_count_stats::live},
+                {"intrusive_ptr_peak_objects", "gauge", "Most objects alive at once.", &ref_count_stats::peak},
+                {"intrusive_ptr_created_total", "counter", "Objects created.", &ref_count_stats::created},
+                {"intrusive_ptr_destroyed_total", "counter", "Objects destroyed.", &ref_count_stats::destroyed},
+                {"intrusive_ptr_add_refs_total", "counter", "References added.", &ref_count_stats::add_refs},
+                {"intrusive_ptr_releases_total", "counter", "References released.", &ref_count_stats::releases},
+                {"intrusive_ptr_cross_thread_releases_total", "counter",
+                 "References released on a thread other than the creating one.",
+                 &ref_count_stats::cross_thread_releases},
+        };
+        auto snapshot = ref_count_snapshot();
+        std::string out;
+        for (auto &m : metrics) {
+            out += "# HELP ";
+            out += m.name;
+            out += ' ';
+            out += m.help;
+            out += "\n# TYPE ";
+            out += m.name;
+            out += ' ';
+            out += m.type;
+            out += '\n';
+            for (auto &stats : snapshot) {
+                out += m.name;
+                out += "{type=\"";
+                out += escape_label(stats.type_name);
+                out += "\"} ";
+                out += std::to_string(stats.*m.value);
+                out += '\n';
+            }
+        }
+        return out;
+    }
+
+    std::vector<long_lived_sample> long_lived_objects(std::chrono::steady_clock::duration min_age) {
+        std::vector<sample> old;
+        auto now = std::chrono::steady_clock::now();
+        {
+            auto &table = samples();
+            std::lock_guard<std::mutex> lock(table.mtx);
+            for (auto &entry : table.live) {
+                if (now - entry.second.created >= min_age) {
+                    old.push_back(entry.second);
+                }
+            }
+        }
+        std::vector<long_lived_sample> result;
+        result.reserve(old.size());
+        for (auto &entry : old) {
+            long_lived_sample out;
+            out.type_name = type_name_of(*entry.type);
+            out.age = now - entry.created;
+            out.callsite = symbolize(entry.frames, entry.depth);
+            result.push_back(std::move(out));
+        }
+        return result;
+    }
+
+    void set_ref_count_sample_rate(unsigned one_in) noexcept {
+        sample_rate.store(one_in, std::memory_order_relaxed);
+    }
+
+} //
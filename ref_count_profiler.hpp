@@ -0,0 +1,114 @@
+#ifndef REF_COUNT_PROFILER_HPP
+#define REF_COUNT_PROFILER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+
+namespace std {
+
+    // Refcount profiler for builds with INTRUSIVE_PTR_INSTRUMENT defined.
+    //
+    // The macro changes the layout of basic_ref_counted, so it has to be
+    // set for every translation unit of a program (the CMake option sets it
+    // on the ref_counted target for all of its users). Without it nothing is
+    // recorded and basic_ref_counted carries no extra state or code; the
+    // snapshot functions below then report nothing.
+    //
+    // Counters are per most derived type (CRTP bases) or per counter policy
+    // (ref_counted with Derived = void). They only grow, except live; rates
+    // are left to the scraper.
+
+    struct ref_count_stats {
+        std::string type_name;
+        uint64_t live;
+        uint64_t peak;
+        uint64_t created;
+        uint64_t destroyed;
+        uint64_t add_refs;
+        uint64_t releases;
+        // releases made on a thread other than the creating one
+        uint64_t cross_thread_releases;
+    };
+
+    struct long_lived_sample {
+        std::string type_name;
+        std::chrono::steady_clock::duration age;
+        // symbolized creation backtrace, innermost frame first; empty where
+        // backtraces are unavailable
+        std::vector<std::string> callsite;
+    };
+
+    std::vector<ref_count_stats> ref_count_snapshot();
+
+    // Prometheus text exposition of ref_count_snapshot().
+    std::string ref_count_prometheus();
+
+    // Sampled objects that are still alive and older than min_age.
+    std::vector<long_lived_sample> long_lived_objects(std::chrono::steady_clock::duration min_age);
+
+    // Samples the creation callsite of one in every one_in objects per
+    // thread; 0 disables sampling. The default is 1024.
+    void set_ref_count_sample_rate(unsigned one_in) noexcept;
+
+    namespace intrusive_detail {
+
+        struct ref_count_type_record {
+            explicit ref_count_type_record(const std::type_info &type) noexcept;
+
+            const std::type_info &type;
+            std::atomic<uint64_t> live{0};
+            std::atomic<uint64_t> peak{0};
+            std::atomic<uint64_t> created{0};
+            std::atomic<uint64_t> destroyed{0};
+            std::atomic<uint64_t> add_refs{0};
+            std::atomic<uint64_t> releases{0};
+            std::atomic<uint64_t> cross_thread_releases{0};
+            ref_count_type_record *next = nullptr;
+        };
+
+        template <class Tag>
+        inline ref_count_type_record &ref_count_record_of() noexcept {
+            static ref_count_type_record record(typeid(Tag));
+            return record;
+        }
+
+        inline const void *ref_count_thread_token() noexcept {
+            static thread_local char token;
+            return &token;
+        }
+
+        // Per-object state of instrumented builds.
+        struct ref_count_probe {
+            const void *creator;
+            bool sampled;
+        };
+
+        void ref_count_note_created(ref_count_type_record &record, ref_count_probe &probe,
+                                    const void *object) noexcept;
+
+        void ref_count_note_destroyed(ref_count_type_record &record, const ref_count_probe &probe,
+                                      const void *object) noexcept;
+
+        inline void ref_count_note_ref(ref_count_type_record &record, size_t n) noexcept {
+            record.add_refs.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        inline void ref_count_note_release(ref_count_type_record &record, const ref_count_probe &probe,
+                                           size_t n) noexcept {
+            record.releases.fetch_add(n, std::memory_order_relaxed);
+            if (probe.creator != ref_count_thread_token()) {
+                record.cross_thread_releases.fetch_add(n, std::memory_order_relaxed);
+            }
+        }
+
+    }
+
+}
+
+#endif // REF_COUNT_PROFILER_HPP
@@ -3,47 +3,339 @@
 
 #include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <type_traits>
+
+#ifndef NDEBUG
+#include <cassert>
+#include <thread>
+#endif
+
+
+#ifdef INTRUSIVE_PTR_INSTRUMENT
+#include "ref_count_profiler.hpp"
+#endif
+
+
+#if defined(__SANITIZE_THREAD__)
+#define INTRUSIVE_PTR_TSAN 1
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define INTRUSIVE_PTR_TSAN 1
+#endif
+#endif
 
 
 namespace std {
 
-    class ref_counted {
+    namespace intrusive_detail {
+
+        // Acquire side of the release-decrement that dropped the last ref.
+        // ThreadSanitizer does not model standalone fences, so sanitized
+        // builds use an acquire load of the counter, which synchronizes with
+        // the same release sequence.
+        template <class T>
+        inline void acquire_last_release(const std::atomic<T> &counter) noexcept {
+#ifdef INTRUSIVE_PTR_TSAN
+            counter.load(std::memory_order_acquire);
+#else
+            (void) counter;
+            std::atomic_thread_fence(std::memory_order_acquire);
+#endif
+        }
+
+    }
+
+    // Counter policies for basic_ref_counted. A policy starts at the given
+    // count, increment(n)/decrement(n) change it by n in one step, and
+    // decrement() returns true when the count drops to zero.
+    // bind() hands the policy its owning object and a function that destroys
+    // it, for policies that may detect zero outside of decrement().
+
+    class atomic_ref_count {
     public:
-        ~ref_counted();
+        explicit atomic_ref_count(size_t initial) noexcept : rc_(initial) {}
 
-        ref_counted();
+        inline void bind(void *, void (*)(void *)) noexcept {
+            // nop
+        }
 
-        ref_counted(const ref_counted &);
+        inline void increment(size_t n = 1) noexcept {
+            rc_.fetch_add(n, std::memory_order_relaxed);
+        }
 
-        ref_counted &operator=(const ref_counted &);
+        // One RMW per release. The acquire fence is only paid by the thread
+        // that drops the last ref, so it sees every write made through the
+        // other refs before the object is destroyed.
+        inline bool decrement(size_t n = 1) noexcept {
+            if (rc_.fetch_sub(n, std::memory_order_release) == n) {
+                intrusive_detail::acquire_last_release(rc_);
+                return true;
+            }
+            return false;
+        }
+
+        inline size_t load() const noexcept {
+            return rc_.load(std::memory_order_acquire);
+        }
+
+    private:
+        std::atomic<size_t> rc_;
+    };
+
+    // atomic_ref_count with a 32-bit counter, for objects that are small
+    // enough for the extra four bytes to matter. A count that would pass
+    // UINT32_MAX terminates the process instead of wrapping to an early free.
+    class atomic_ref_count32 {
+    public:
+        explicit atomic_ref_count32(size_t initial) noexcept : rc_(static_cast<uint32_t>(initial)) {}
+
+        inline void bind(void *, void (*)(void *)) noexcept {
+            // nop
+        }
+
+        inline void increment(size_t n = 1) noexcept {
+            if (n > UINT32_MAX || rc_.fetch_add(static_cast<uint32_t>(n), std::memory_order_relaxed) > UINT32_MAX - n) {
+                std::terminate();
+            }
+        }
 
-        inline void ref() noexcept {
-            rc_.fetch_add(1, std::memory_order_relaxed);
+        inline bool decrement(size_t n = 1) noexcept {
+            if (rc_.fetch_sub(static_cast<uint32_t>(n), std::memory_order_release) == n) {
+                intrusive_detail::acquire_last_release(rc_);
+                return true;
+            }
+            return false;
         }
 
-        void deref() noexcept;
+        inline size_t load() const noexcept {
+            return rc_.load(std::memory_order_acquire);
+        }
+
+    private:
+        std::atomic<uint32_t> rc_;
+    };
+
+    // For objects that never leave one thread: copies are plain increments.
+    class plain_ref_count {
+    public:
+        explicit plain_ref_count(size_t initial) noexcept : rc_(initial) {}
+
+        inline void bind(void *, void (*)(void *)) noexcept {
+            // nop
+        }
+
+        inline void increment(size_t n = 1) noexcept {
+            rc_ += n;
+        }
+
+        inline bool decrement(size_t n = 1) noexcept {
+            return (rc_ -= n) == 0;
+        }
+
+        inline size_t load() const noexcept {
+            return rc_;
+        }
+
+    private:
+        size_t rc_;
+    };
+
+    // Same as plain_ref_count, but debug builds assert that every count change
+    // happens on the thread that created the object.
+    class thread_confined_ref_count {
+    public:
+        explicit thread_confined_ref_count(size_t initial) noexcept : rc_(initial) {}
+
+        inline void bind(void *, void (*)(void *)) noexcept {
+            // nop
+        }
+
+        inline void increment(size_t n = 1) noexcept {
+            check_owner();
+            rc_ += n;
+        }
+
+        inline bool decrement(size_t n = 1) noexcept {
+            check_owner();
+            return (rc_ -= n) == 0;
+        }
+
+        inline size_t load() const noexcept {
+            return rc_;
+        }
+
+    private:
+        inline void check_owner() const noexcept {
+#ifndef NDEBUG
+            assert(owner_ == std::this_thread::get_id() && "ref count changed outside of the owning thread");
+#endif
+        }
+
+        size_t rc_;
+#ifndef NDEBUG
+        std::thread::id owner_ = std::this_thread::get_id();
+#endif
+    };
+
+    namespace intrusive_detail {
+
+        template <class Base, class Derived>
+        struct ref_counted_reclaim {
+            static void reclaim(void *ptr) noexcept {
+                Derived::destroy(static_cast<Derived *>(static_cast<Base *>(ptr)));
+            }
+        };
+
+        template <class Base>
+        struct ref_counted_reclaim<Base, void> {
+            static void reclaim(void *ptr) noexcept {
+                // the destructor is virtual, see ref_counted_root<true>
+                delete static_cast<Base *>(ptr);
+            }
+        };
+
+        template <bool Polymorphic>
+        struct ref_counted_root {
+            // nop
+        };
+
+        template <>
+        struct ref_counted_root<true> {
+            virtual ~ref_counted_root() {
+                // nop
+            }
+        };
+
+    }
+
+    // Header-only reference counted base.
+    //
+    // With Derived = void the base has a virtual destructor and the last
+    // deref() deletes the object through it. Pass the most derived type
+    // instead (CRTP) and the last deref() calls Derived::destroy(Derived*)
+    // with no vtable and no virtual dispatch. The inherited destroy() deletes the object;
+    // a Derived that declares its own accessible static destroy() hides it
+    // and can hand the object back to a pool or an arena.
+    //
+    // Builds with INTRUSIVE_PTR_INSTRUMENT report every count change to the
+    // refcount profiler (ref_count_profiler.hpp).
+    template <class CounterPolicy, class Derived = void>
+    class basic_ref_counted : public intrusive_detail::ref_counted_root<is_void<Derived>::value> {
+    public:
+        using counter_policy = CounterPolicy;
+
+        ~basic_ref_counted() {
+            // nop
+        }
+
+        basic_ref_counted() : rc_(1) {
+            rc_.bind(this, &reclaim);
+            note_created();
+        }
+
+        basic_ref_counted(const basic_ref_counted &) : rc_(1) {
+            // don't copy reference count
+            rc_.bind(this, &reclaim);
+            note_created();
+        }
+
+        basic_ref_counted &operator=(const basic_ref_counted &) {
+            // nop; intentionally don't copy reference count
+            return *this;
+        }
+
+        inline void ref(size_t n = 1) noexcept {
+#ifdef INTRUSIVE_PTR_INSTRUMENT
+            intrusive_detail::ref_count_note_ref(profile_record(), n);
+#endif
+            rc_.increment(n);
+        }
+
+        inline void deref(size_t n = 1) noexcept {
+#ifdef INTRUSIVE_PTR_INSTRUMENT
+            intrusive_detail::ref_count_note_release(profile_record(), probe_, n);
+#endif
+            if (rc_.decrement(n)) {
+                reclaim(this);
+            }
+        }
 
         inline bool unique() const noexcept {
-            return rc_ == 1;
+            return rc_.load() == 1;
         }
 
         inline size_t get_reference_count() const noexcept {
-            return rc_;
+            return rc_.load();
+        }
+
+        template <class T>
+        static void destroy(T *ptr) noexcept {
+            delete ptr;
         }
 
     protected:
-        std::atomic<size_t> rc_;
+        CounterPolicy rc_;
+
+    private:
+        static void reclaim(void *ptr) noexcept {
+#ifdef INTRUSIVE_PTR_INSTRUMENT
+            intrusive_detail::ref_count_note_destroyed(profile_record(), static_cast<basic_ref_counted *>(ptr)->probe_,
+                                                       ptr);
+#endif
+            intrusive_detail::ref_counted_reclaim<basic_ref_counted, Derived>::reclaim(ptr);
+        }
+
+        inline void note_created() noexcept {
+#ifdef INTRUSIVE_PTR_INSTRUMENT
+            intrusive_detail::ref_count_note_created(profile_record(), probe_, this);
+#endif
+        }
+
+#ifdef INTRUSIVE_PTR_INSTRUMENT
+        static inline intrusive_detail::ref_count_type_record &profile_record() noexcept {
+            using tag = typename conditional<is_void<Derived>::value, basic_ref_counted, Derived>::type;
+            return intrusive_detail::ref_count_record_of<tag>();
+        }
+
+        intrusive_detail::ref_count_probe probe_;
+#endif
     };
 
-    inline void intrusive_ptr_add_ref(ref_counted *p) {
+    using ref_counted = basic_ref_counted<atomic_ref_count>;
+
+    using ref_counted32 = basic_ref_counted<atomic_ref_count32>;
+
+    using local_ref_counted = basic_ref_counted<plain_ref_count>;
+
+    using thread_confined_ref_counted = basic_ref_counted<thread_confined_ref_count>;
+
+    template <class Derived, class CounterPolicy = atomic_ref_count>
+    using ref_counted_base = basic_ref_counted<CounterPolicy, Derived>;
+
+    template <class CounterPolicy, class Derived>
+    inline void intrusive_ptr_add_ref(basic_ref_counted<CounterPolicy, Derived> *p) {
         p->ref();
     }
 
 
-    inline void intrusive_ptr_release(ref_counted *p) {
+    template <class CounterPolicy, class Derived>
+    inline void intrusive_ptr_release(basic_ref_counted<CounterPolicy, Derived> *p) {
         p->deref();
     }
 
+    // Bulk variants: n refs in a single counter update.
+    template <class CounterPolicy, class Derived>
+    inline void intrusive_ptr_add_ref(basic_ref_counted<CounterPolicy, Derived> *p, size_t n) {
+        p->ref(n);
+    }
+
+    template <class CounterPolicy, class Derived>
+    inline void intrusive_ptr_release(basic_ref_counted<CounterPolicy, Derived> *p, size_t n) {
+        p->deref(n);
+    }
+
 }
 
 #endif // REF_COUNTED_HPP
@@ -0,0 +1,200 @@
+#ifndef SHARDED_REF_COUNT_HPP
+#define SHARDED_REF_COUNT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include "ref_counted.hpp"
+
+
+namespace std {
+
+    namespace intrusive_detail {
+
+        constexpr size_t cache_line_size = 64;
+
+        // Heap memory for cache-line aligned objects. Plain new only honours
+        // extended alignment from C++17 on.
+        inline void *cache_aligned_allocate(size_t size) {
+#ifdef __cpp_aligned_new
+            return ::operator new(size, align_val_t(cache_line_size));
+#else
+            void *ptr = nullptr;
+            if (posix_memalign(&ptr, cache_line_size, size) != 0) {
+                throw bad_alloc();
+            }
+            return ptr;
+#endif
+        }
+
+        inline void cache_aligned_deallocate(void *ptr) noexcept {
+#ifdef __cpp_aligned_new
+            ::operator delete(ptr, align_val_t(cache_line_size));
+#else
+            free(ptr);
+#endif
+        }
+
+    }
+
+    // Picks a shard for the calling thread. Threads are spread round-robin
+    // over the shards the first time they touch a sharded counter.
+    struct thread_shard_selector {
+        static inline size_t index() noexcept {
+            static thread_local size_t shard = next_shard();
+            return shard;
+        }
+
+    private:
+        static inline size_t next_shard() noexcept {
+            static std::atomic<size_t> counter{0};
+            return counter.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+
+    // Counter policy for a few hot, long-lived objects copied from every core.
+    //
+    // While the object is live, every count change touches only the calling
+    // thread's cache-line padded shard, and individual shards may go negative
+    // when refs migrate. Zero cannot be detected in that mode, so the owner of
+    // the object calls kill() once it stops publishing it (for example when a
+    // global is replaced or at shutdown). kill() folds all shards into one
+    // central atomic counter, and from then on the policy behaves like
+    // atomic_ref_count and destroys the object when the count reaches zero.
+    //
+    // kill() swaps every shard with a dead marker, so each concurrent shard
+    // update either lands before the swap and is folded in, or sees the
+    // marker and is redone on the central counter. The central counter starts
+    // at a large bias that is removed by the fold, so it cannot reach zero
+    // before the fold is complete.
+    template <size_t Shards = 16, class ShardSelector = thread_shard_selector>
+    class sharded_ref_count {
+    public:
+        static_assert(Shards > 0, "at least one shard is required");
+
+        explicit sharded_ref_count(size_t initial) noexcept : central_(central_bias) {
+            for (auto &slot : shards_) {
+                slot.count.store(0, std::memory_order_relaxed);
+            }
+            shards_[0].count.store(static_cast<intptr_t>(initial), std::memory_order_relaxed);
+        }
+
+        inline void bind(void *object, void (*reclaim)(void *)) noexcept {
+            object_ = object;
+            reclaim_ = reclaim;
+        }
+
+        inline void increment(size_t n = 1) noexcept {
+            auto delta = static_cast<intptr_t>(n);
+            if (!killed_.load(std::memory_order_relaxed) &&
+                local_shard().fetch_add(delta, std::memory_order_relaxed) > dead_threshold) {
+                return;
+            }
+            central_.fetch_add(delta, std::memory_order_relaxed);
+        }
+
+        inline bool decrement(size_t n = 1) noexcept {
+            auto delta = static_cast<intptr_t>(n);
+            if (!killed_.load(std::memory_order_relaxed) &&
+                local_shard().fetch_sub(delta, std::memory_order_release) > dead_threshold) {
+                return false;
+            }
+            return release_central(delta);
+        }
+
+        // Exact after kill(), a snapshot before.
+        inline size_t load() const noexcept {
+            if (killed_.load(std::memory_order_acquire)) {
+                return static_cast<size_t>(central_.load(std::memory_order_acquire));
+            }
+            intptr_t sum = 0;
+            for (auto &slot : shards_) {
+                sum += slot.count.load(std::memory_order_relaxed);
+            }
+            return static_cast<size_t>(sum);
+        }
+
+        inline bool killed() const noexcept {
+            return killed_.load(std::memory_order_acquire);
+        }
+
+        // Switches to central counting and destroys the object right away if
+        // no refs are left. Must be called at most once.
+        void kill() noexcept {
+            killed_.store(true, std::memory_order_release);
+            intptr_t sum = 0;
+            for (auto &slot : shards_) {
+                sum += slot.count.exchange(dead_marker, std::memory_order_acq_rel);
+            }
+            auto value = central_.fetch_add(sum - central_bias, std::memory_order_acq_rel) + sum - central_bias;
+            if (value == 0) {
+                reclaim_(object_);
+            }
+        }
+
+    private:
+        static constexpr intptr_t dead_marker = INTPTR_MIN / 2;
+        static constexpr intptr_t dead_threshold = INTPTR_MIN / 4;
+        static constexpr intptr_t central_bias = intptr_t{1} << 40;
+
+        struct alignas(intrusive_detail::cache_line_size) shard {
+            std::atomic<intptr_t> count;
+        };
+
+        inline std::atomic<intptr_t> &local_shard() noexcept {
+            return shards_[ShardSelector::index() % Shards].count;
+        }
+
+        inline bool release_central(intptr_t n) noexcept {
+            if (central_.fetch_sub(n, std::memory_order_release) == n) {
+                intrusive_detail::acquire_last_release(central_);
+                return true;
+            }
+            return false;
+        }
+
+        shard shards_[Shards];
+        alignas(intrusive_detail::cache_line_size) std::atomic<intptr_t> central_;
+        std::atomic<bool> killed_{false};
+        void *object_ = nullptr;
+        void (*reclaim_)(void *) = nullptr;
+    };
+
+    template <size_t Shards, class ShardSelector>
+    constexpr intptr_t sharded_ref_count<Shards, ShardSelector>::dead_marker;
+
+    template <size_t Shards, class ShardSelector>
+    constexpr intptr_t sharded_ref_count<Shards, ShardSelector>::dead_threshold;
+
+    template <size_t Shards, class ShardSelector>
+    constexpr intptr_t sharded_ref_count<Shards, ShardSelector>::central_bias;
+
+    // Base for hot shared objects; intrusive_ptr works unchanged. Call kill()
+    // once the owner stops handing out the object. The shards make derived
+    // types cache-line aligned, so new and delete go through aligned memory.
+    template <class Derived = void, size_t Shards = 16, class ShardSelector = thread_shard_selector>
+    class sharded_ref_counted : public basic_ref_counted<sharded_ref_count<Shards, ShardSelector>, Derived> {
+    public:
+        static void *operator new(size_t size) {
+            return intrusive_detail::cache_aligned_allocate(size);
+        }
+
+        static void operator delete(void *ptr) noexcept {
+            intrusive_detail::cache_aligned_deallocate(ptr);
+        }
+
+        void kill() noexcept {
+            this->rc_.kill();
+        }
+
+        bool killed() const noexcept {
+            return this->rc_.killed();
+        }
+    };
+
+}
+
+#endif // SHARDED_REF_COUNT_HPP
@@ -0,0 +1,132 @@
+#include "shared_buffer.hpp"
+
+#include <climits>
+
+#include <unistd.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+namespace std {
+
+    constexpr size_t buffer_slice::npos;
+
+    void buffer_chain::append(const buffer_chain &other) {
+        if (&other == this) {
+            buffer_chain copy(other);
+            append(std::move(copy));
+            return;
+        }
+        for (size_t i = other.first_; i < other.iov_.size(); ++i) {
+            auto &segment = other.iov_[i];
+            append(buffer_slice(other.owners_[i],
+                                static_cast<size_t>(static_cast<const unsigned char *>(segment.iov_base) -
+                                                    other.owners_[i]->data()),
+                                segment.iov_len));
+        }
+    }
+
+    void buffer_chain::append(buffer_chain &&other) {
+        if (empty()) {
+            swap(iov_, other.iov_);
+            swap(owners_, other.owners_);
+            swap(first_, other.first_);
+            swap(size_, other.size_);
+            other.clear();
+            return;
+        }
+        for (size_t i = other.first_; i < other.iov_.size(); ++i) {
+            auto &segment = other.iov_[i];
+            auto offset = static_cast<size_t>(static_cast<const unsigned char *>(segment.iov_base) -
+                                              other.owners_[i]->data());
+            append(buffer_slice(std::move(other.owners_[i]), offset, segment.iov_len));
+        }
+        other.clear();
+    }
+
+    void buffer_chain::consume(size_t n) noexcept {
+        assert(n <= size_ && "consuming more bytes than the chain holds");
+        size_ -= n;
+        while (n) {
+            auto &segment = iov_[first_];
+            if (n < segment.iov_len) {
+                segment.iov_base = static_cast<unsigned char *>(segment.iov_base) + n;
+                segment.iov_len -= n;
+                return;
+            }
+            n -= segment.iov_len;
+            owners_[first_].reset();
+            ++first_;
+        }
+        if (first_ == iov_.size()) {
+            clear();
+        } else if (first_ * 2 > iov_.size()) {
+            // keep front consumption amortized O(1)
+            iov_.erase(iov_.begin(), iov_.begin() + static_cast<ptrdiff_t>(first_));
+            owners_.erase(owners_.begin(), owners_.begin() + static_cast<ptrdiff_t>(first_));
+            first_ = 0;
+        }
+    }
+
+    void buffer_chain::clear() noexcept {
+        iov_.clear();
+        owners_.clear();
+        first_ = 0;
+        size_ = 0;
+    }
+
+    buffer_chain buffer_chain::slice(size_t offset, size_t length) const {
+        buffer_chain result;
+        for (size_t i = first_; i < iov_.size() && length; ++i) {
+            auto &segment = iov_[i];
+            if (offset >= segment.iov_len) {
+                offset -= segment.iov_len;
+                continue;
+            }
+            auto start = static_cast<size_t>(static_cast<const unsigned char *>(segment.iov_base) -
+                                             owners_[i]->data()) + offset;
+            auto take = segment.iov_len - offset;
+            if (take > length) {
+                take = length;
+            }
+            result.append(buffer_slice(owners_[i], start, take));
+            length -= take;
+            offset = 0;
+        }
+        return result;
+    }
+
+    buffer_slice buffer_chain::flatten() const {
+        if (iov_count() == 1) {
+            auto &segment = iov_[first_];
+            return buffer_slice(owners_[first_],
+                                static_cast<size_t>(static_cast<const unsigned char *>(segment.iov_base) -
+                                                    owners_[first_]->data()),
+                                segment.iov_len);
+        }
+        if (empty()) {
+            return buffer_slice();
+        }
+        auto buffer = shared_buffer::create(size_);
+        auto out = buffer->data();
+        for (size_t i = first_; i < iov_.size(); ++i) {
+            std::memcpy(out, iov_[i].iov_base, iov_[i].iov_len);
+            out += iov_[i].iov_len;
+        }
+        return buffer_slice(std::move(buffer));
+    }
+
+    ssize_t write_chain(int fd, buffer_chain &chain) noexcept {
+        if (chain.empty()) {
+            return 0;
+        }
+        auto count = chain.iov_count() < IOV_MAX ? chain.iov_count() : static_cast<size_t>(IOV_MAX);
+        auto written = ::writev(fd, chain.iov(), static_cast<int>(count));
+        if (written > 0) {
+            chain.consume(static_cast<size_t>(written));
+        }
+        return written;
+    }
+
+} //
@@ -0,0 +1,256 @@
+#ifndef SHARED_BUFFER_HPP
+#define SHARED_BUFFER_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "intrusive_ptr.hpp"
+#include "ref_counted.hpp"
+
+
+namespace std {
+
+    // Byte storage with the count in its header: one allocation holds the
+    // counter, the capacity and the bytes. Fill it through data() before
+    // handing out slices; slices and chains only ever read.
+    class shared_buffer : public basic_ref_counted<atomic_ref_count, shared_buffer> {
+    public:
+        shared_buffer(const shared_buffer &) = delete;
+
+        shared_buffer &operator=(const shared_buffer &) = delete;
+
+        static intrusive_ptr<shared_buffer> create(size_t capacity) {
+            auto storage = ::operator new(sizeof(shared_buffer) + capacity);
+            return intrusive_ptr<shared_buffer>(::new (storage) shared_buffer(capacity), adopt_ref);
+        }
+
+        static intrusive_ptr<shared_buffer> copy_of(const void *bytes, size_t size) {
+            auto buffer = create(size);
+            if (size) {
+                std::memcpy(buffer->data(), bytes, size);
+            }
+            return buffer;
+        }
+
+        static void destroy(shared_buffer *ptr) noexcept {
+            ptr->~shared_buffer();
+            ::operator delete(ptr);
+        }
+
+        inline unsigned char *data() noexcept {
+            return reinterpret_cast<unsigned char *>(this + 1);
+        }
+
+        inline const unsigned char *data() const noexcept {
+            return reinterpret_cast<const unsigned char *>(this + 1);
+        }
+
+        inline size_t capacity() const noexcept {
+            return capacity_;
+        }
+
+    private:
+        explicit shared_buffer(size_t capacity) noexcept : capacity_(capacity) {
+            // nop
+        }
+
+        size_t capacity_;
+    };
+
+    // Read-only view of a byte range that keeps its buffer alive. Copying a
+    // slice adds one ref; moving it, or narrowing it in place, adds none.
+    class buffer_slice {
+    public:
+        static constexpr size_t npos = static_cast<size_t>(-1);
+
+        buffer_slice() noexcept : data_(nullptr), size_(0) {
+            // nop
+        }
+
+        explicit buffer_slice(intrusive_ptr<shared_buffer> buffer) noexcept
+                : data_(buffer ? buffer->data() : nullptr), size_(buffer ? buffer->capacity() : 0),
+                  owner_(std::move(buffer)) {
+            // nop
+        }
+
+        buffer_slice(intrusive_ptr<shared_buffer> buffer, size_t offset, size_t length) noexcept
+                : data_(buffer->data() + offset), size_(length), owner_(std::move(buffer)) {
+            assert(offset <= owner_->capacity() && length <= owner_->capacity() - offset &&
+                   "slice out of buffer bounds");
+        }
+
+        inline const unsigned char *data() const noexcept {
+            return data_;
+        }
+
+        inline size_t size() const noexcept {
+            return size_;
+        }
+
+        inline bool empty() const noexcept {
+            return size_ == 0;
+        }
+
+        inline const unsigned char *begin() const noexcept {
+            return data_;
+        }
+
+        inline const unsigned char *end() const noexcept {
+            return data_ + size_;
+        }
+
+        inline unsigned char operator[](size_t index) const noexcept {
+            return data_[index];
+        }
+
+        inline const intrusive_ptr<shared_buffer> &owner() const noexcept {
+            return owner_;
+        }
+
+        // Bytes [offset, offset + length) of this slice, clamped to its end.
+        buffer_slice slice(size_t offset, size_t length = npos) const & noexcept {
+            buffer_slice result(*this);
+            result.narrow(offset, length);
+            return result;
+        }
+
+        buffer_slice slice(size_t offset, size_t length = npos) && noexcept {
+            narrow(offset, length);
+            return std::move(*this);
+        }
+
+        inline void remove_prefix(size_t n) noexcept {
+            assert(n <= size_ && "prefix longer than the slice");
+            data_ += n;
+            size_ -= n;
+        }
+
+        inline void remove_suffix(size_t n) noexcept {
+            assert(n <= size_ && "suffix longer than the slice");
+            size_ -= n;
+        }
+
+    private:
+        friend class buffer_chain;
+
+        inline void narrow(size_t offset, size_t length) noexcept {
+            assert(offset <= size_ && "slice offset past the end");
+            data_ += offset;
+            size_ -= offset;
+            if (length < size_) {
+                size_ = length;
+            }
+        }
+
+        const unsigned char *data_;
+        size_t size_;
+        intrusive_ptr<shared_buffer> owner_;
+    };
+
+    // Sequence of slices kept as an iovec array, ready for writev() or an
+    // io_uring writev SQE: iov() and iov_count() point straight at it. Each
+    // segment holds a ref to its buffer; appending a slice that continues the
+    // last segment in the same buffer extends that segment instead.
+    class buffer_chain {
+    public:
+        buffer_chain() noexcept : first_(0), size_(0) {
+            // nop
+        }
+
+        void append(const buffer_slice &slice) {
+            if (!extend(slice)) {
+                push(slice.owner(), slice);
+            }
+        }
+
+        void append(buffer_slice &&slice) {
+            if (!extend(slice)) {
+                push(std::move(slice.owner_), slice);
+            }
+        }
+
+        void append(const buffer_chain &other);
+
+        void append(buffer_chain &&other);
+
+        inline const iovec *iov() const noexcept {
+            return iov_.data() + first_;
+        }
+
+        inline size_t iov_count() const noexcept {
+            return iov_.size() - first_;
+        }
+
+        // Total bytes over all segments.
+        inline size_t size() const noexcept {
+            return size_;
+        }
+
+        inline bool empty() const noexcept {
+            return size_ == 0;
+        }
+
+        // Drops the first n bytes, for example after a partial writev().
+        void consume(size_t n) noexcept;
+
+        void clear() noexcept;
+
+        // Bytes [offset, offset + length) as a new chain sharing the buffers.
+        buffer_chain slice(size_t offset, size_t length = buffer_slice::npos) const;
+
+        // One contiguous slice: shared if the chain has a single segment,
+        // otherwise a copy into a new buffer.
+        buffer_slice flatten() const;
+
+    private:
+        bool extend(const buffer_slice &slice) noexcept {
+            if (slice.empty()) {
+                return true;
+            }
+            if (iov_count() == 0 || owners_.back() != slice.owner()) {
+                return false;
+            }
+            auto &last = iov_.back();
+            if (static_cast<const unsigned char *>(last.iov_base) + last.iov_len != slice.data()) {
+                return false;
+            }
+            last.iov_len += slice.size();
+            size_ += slice.size();
+            return true;
+        }
+
+        template <class Owner>
+        void push(Owner &&owner, const buffer_slice &slice) {
+            iovec segment;
+            segment.iov_base = const_cast<unsigned char *>(slice.data());
+            segment.iov_len = slice.size();
+            // make room for the owner first, so neither push can leave the
+            // two arrays out of step
+            if (owners_.size() == owners_.capacity()) {
+                owners_.reserve(2 * owners_.size() + 1);
+            }
+            iov_.push_back(segment);
+            owners_.push_back(std::forward<Owner>(owner));
+            size_ += slice.size();
+        }
+
+        std::vector<iovec> iov_;
+        std::vector<intrusive_ptr<shared_buffer>> owners_;
+        size_t first_;
+        size_t size_;
+    };
+
+    // One writev() of as many segments as the platform allows; the written
+    // bytes are consumed from chain. Returns what writev() returned.
+    ssize_t write_chain(int fd, buffer_chain &chain) noexcept;
+
+}
+
+#endif // SHARED_BUFFER_HPP
@@ -0,0 +1,193 @@
+#include "slab_allocator.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+
+namespace std {
+
+    namespace {
+
+        constexpr size_t chunk_size = 64 * 1024;
+        constexpr size_t min_block_shift = 4;
+        constexpr size_t class_count = 10; // 16 .. slab_max_block
+        constexpr size_t large_class = class_count;
+        constexpr size_t large_offset = 64;
+
+        static_assert((size_t{1} << (min_block_shift + class_count - 1)) == slab_max_block,
+                      "size classes must end at slab_max_block");
+
+        struct slab_heap;
+
+        struct chunk_header {
+            slab_heap *owner;
+            size_t size_class;
+        };
+
+        struct free_block {
+            free_block *next;
+        };
+
+        struct slab_heap {
+            free_block *free_list[class_count] = {};
+            unsigned char *bump[class_count] = {};
+            unsigned char *bump_end[class_count] = {};
+            std::atomic<free_block *> remote_free{nullptr};
+            slab_heap *next_free = nullptr;
+        };
+
+        inline size_t block_size(size_t size_class) {
+            return size_t{1} << (min_block_shift + size_class);
+        }
+
+        inline size_t size_class_of(size_t size) {
+            size_t size_class = 0;
+            while (block_size(size_class) < size) {
+                ++size_class;
+            }
+            return size_class;
+        }
+
+        inline chunk_header *chunk_of(void *ptr) {
+            return reinterpret_cast<chunk_header *>(reinterpret_cast<uintptr_t>(ptr) & ~(chunk_size - 1));
+        }
+
+        void *allocate_chunk(size_t size) {
+            void *ptr = nullptr;
+            if (posix_memalign(&ptr, chunk_size, size) != 0) {
+                throw std::bad_alloc();
+            }
+            return ptr;
+        }
+
+        std::mutex &heap_pool_mutex() {
+            static std::mutex mtx;
+            return mtx;
+        }
+
+        slab_heap *&heap_pool() {
+            static slab_heap *head = nullptr;
+            return head;
+        }
+
+        thread_local slab_heap *current_heap = nullptr;
+        thread_local bool thread_exiting = false;
+
+        void reclaim_remote(slab_heap *heap) {
+            auto block = heap->remote_free.exchange(nullptr, std::memory_order_acquire);
+            while (block) {
+                auto next = block->next;
+                auto size_class = chunk_of(block)->size_class;
+                block->next = heap->free_list[size_class];
+                heap->free_list[size_class] = block;
+                block = next;
+            }
+        }
+
+        slab_heap *attach_thread() {
+            struct attachment {
+                slab_heap *heap = nullptr;
+
+                ~attachment() {
+                    if (!heap) {
+                        return;
+                    }
+                    current_heap = nullptr;
+                    thread_exiting = true;
+                    std::lock_guard<std::mutex> guard(heap_pool_mutex());
+                    heap->next_free = heap_pool();
+                    heap_pool() = heap;
+                }
+            };
+
+            if (thread_exiting) {
+                return nullptr;
+            }
+            static thread_local attachment current;
+            {
+                std::lock_guard<std::mutex> guard(heap_pool_mutex());
+                current.heap = heap_pool();
+                if (current.heap) {
+                    heap_pool() = current.heap->next_free;
+                    current.heap->next_free = nullptr;
+                }
+            }
+            if (!current.heap) {
+                current.heap = new slab_heap;
+            }
+            current_heap = current.heap;
+            return current.heap;
+        }
+
+        inline slab_heap *thread_heap() {
+            return current_heap ? current_heap : attach_thread();
+        }
+
+        void *allocate_large(size_t size) {
+            auto chunk = static_cast<chunk_header *>(allocate_chunk(
+                    (size + large_offset + chunk_size - 1) / chunk_size * chunk_size));
+            chunk->owner = nullptr;
+            chunk->size_class = large_class;
+            return reinterpret_cast<unsigned char *>(chunk) + large_offset;
+        }
+
+        void refill(slab_heap *heap, size_t size_class) {
+            auto chunk = static_cast<chunk_header *>(allocate_chunk(chunk_size));
+            chunk->owner = heap;
+            chunk->size_class = size_class;
+            auto base = reinterpret_cast<unsigned char *>(chunk);
+            auto block = block_size(size_class);
+            auto first = (sizeof(chunk_header) + block - 1) / block * block;
+            heap->bump[size_class] = base + first;
+            heap->bump_end[size_class] = base + chunk_size;
+        }
+
+    }
+
+    void *slab_allocate(size_t size) {
+        auto heap = thread_heap();
+        if (size > slab_max_block || !heap) {
+            return allocate_large(size);
+        }
+        auto size_class = size_class_of(size);
+        if (!heap->free_list[size_class]) {
+            reclaim_remote(heap);
+        }
+        if (auto block = heap->free_list[size_class]) {
+            heap->free_list[size_class] = block->next;
+            return block;
+        }
+        if (heap->bump[size_class] == heap->bump_end[size_class]) {
+            refill(heap, size_class);
+        }
+        auto result = heap->bump[size_class];
+        heap->bump[size_class] += block_size(size_class);
+        return result;
+    }
+
+    void slab_deallocate(void *ptr) noexcept {
+        if (!ptr) {
+            return;
+        }
+        auto chunk = chunk_of(ptr);
+        if (chunk->size_class == large_class) {
+            free(chunk);
+            return;
+        }
+        auto block = static_cast<free_block *>(ptr);
+        auto owner = chunk->owner;
+        if (owner == current_heap) {
+            block->next = owner->free_list[chunk->size_class];
+            owner->free_list[chunk->size_class] = block;
+            return;
+        }
+        block->next = owner->remote_free.load(std::memory_order_relaxed);
+        while (!owner->remote_free.compare_exchange_weak(block->next, block,
+                                                         std::memory_order_release,
+                                                         std::memory_order_relaxed)) {
+            // retry
+        }
+    }
+
+} //
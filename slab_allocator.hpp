@@ -0,0 +1,72 @@
+#ifndef SLAB_ALLOCATOR_HPP
+#define SLAB_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <new>
+
+#include "ref_counted.hpp"
+
+
+namespace std {
+
+    // Size-class slab allocator with per-thread heaps.
+    //
+    // Blocks are carved from 64 KiB chunks owned by one thread heap, so no
+    // size is needed on free. A block freed on its owner thread goes back to
+    // that thread's free list; a block freed anywhere else is pushed onto the
+    // owner's lock-free remote-free stack, which the owner takes over in one
+    // batch the next time a free list runs dry. Heaps of exited threads are
+    // adopted by new threads, remote frees included. Requests above
+    // slab_max_block get a dedicated chunk.
+    constexpr size_t slab_max_block = 8192;
+
+    void *slab_allocate(size_t size);
+
+    void slab_deallocate(void *ptr) noexcept;
+
+    template <class T>
+    class slab_allocator {
+    public:
+        using value_type = T;
+
+        slab_allocator() noexcept = default;
+
+        template <class U>
+        slab_allocator(const slab_allocator<U> &) noexcept {}
+
+        T *allocate(size_t n) {
+            return static_cast<T *>(slab_allocate(n * sizeof(T)));
+        }
+
+        void deallocate(T *ptr, size_t) noexcept {
+            slab_deallocate(ptr);
+        }
+    };
+
+    template <class T, class U>
+    inline bool operator==(const slab_allocator<T> &, const slab_allocator<U> &) noexcept {
+        return true;
+    }
+
+    template <class T, class U>
+    inline bool operator!=(const slab_allocator<T> &, const slab_allocator<U> &) noexcept {
+        return false;
+    }
+
+    // ref_counted_base whose objects live in the slab heaps; make_intrusive
+    // and plain new pick up the class-level operator new.
+    template <class Derived, class CounterPolicy = atomic_ref_count>
+    class slab_ref_counted : public basic_ref_counted<CounterPolicy, Derived> {
+    public:
+        static void *operator new(size_t size) {
+            return slab_allocate(size);
+        }
+
+        static void operator delete(void *ptr) noexcept {
+            slab_deallocate(ptr);
+        }
+    };
+
+}
+
+#endif // SLAB_ALLOCATOR_HPP
@@ -0,0 +1,286 @@
+#include "task_scheduler.hpp"
+
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace std {
+
+    task::~task() {
+        // nop
+    }
+
+    task::task() noexcept : predecessors_(0) {
+        // nop
+    }
+
+    const intrusive_ptr<task> &task::then(intrusive_ptr<task> next) noexcept {
+        // a replaced continuation would wait on this task forever
+        assert(!continuation_ && "task already has a continuation");
+        assert(next && "continuation is null");
+        next->predecessors_.fetch_add(1, std::memory_order_relaxed);
+        continuation_ = std::move(next);
+        return continuation_;
+    }
+
+    namespace {
+
+        // Chase-Lev deque as formulated by Le, Pop, Cohen and Zappa Nardelli
+        // for C11 atomics, with the seq_cst fences folded into seq_cst
+        // accesses of top and bottom. Only the owner pushes and takes; any
+        // thread steals. Outgrown rings stay alive until the deque is destroyed
+        // because a thief may still be reading them.
+        class work_deque {
+        public:
+            work_deque() : top_(0), bottom_(0) {
+                rings_.emplace_back(new ring(64));
+                ring_.store(rings_.back().get(), std::memory_order_relaxed);
+            }
+
+            void push(task *item) {
+                auto bottom = bottom_.load(std::memory_order_relaxed);
+                auto top = top_.load(std::memory_order_acquire);
+                auto current = ring_.load(std::memory_order_relaxed);
+                if (bottom - top > static_cast<intptr_t>(current->mask)) {
+                    current = grow(current, top, bottom);
+                }
+                current->put(bottom, item);
+                bottom_.store(bottom + 1, std::memory_order_release);
+            }
+
+            task *take() noexcept {
+                auto bottom = bottom_.load(std::memory_order_relaxed) - 1;
+                auto current = ring_.load(std::memory_order_relaxed);
+                bottom_.store(bottom, std::memory_order_seq_cst);
+                auto top = top_.load(std::memory_order_seq_cst);
+                if (top > bottom) {
+                    bottom_.store(bottom + 1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+                auto item = current->get(bottom);
+                if (top == bottom) {
+                    // last element; race the thieves for it
+                    if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                                      std::memory_order_relaxed)) {
+                        item = nullptr;
+                    }
+                    bottom_.store(bottom + 1, std::memory_order_relaxed);
+                }
+                return item;
+            }
+
+            task *steal() noexcept {
+                auto top = top_.load(std::memory_order_seq_cst);
+                auto bottom = bottom_.load(std::memory_order_seq_cst);
+                if (top >= bottom) {
+                    return nullptr;
+                }
+                auto item = ring_.load(std::memory_order_acquire)->get(top);
+                if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                                  std::memory_order_relaxed)) {
+                    return nullptr;
+                }
+                return item;
+            }
+
+        private:
+            struct ring {
+                explicit ring(size_t capacity) : mask(capacity - 1), slots(new std::atomic<task *>[capacity]) {}
+
+                inline task *get(intptr_t index) const noexcept {
+                    return slots[static_cast<size_t>(index) & mask].load(std::memory_order_relaxed);
+                }
+
+                inline void put(intptr_t index, task *item) noexcept {
+                    slots[static_cast<size_t>(index) & mask].store(item, std::memory_order_relaxed);
+                }
+
+                size_t mask;
+                std::unique_ptr<std::atomic<task *>[]> slots;
+            };
+
+            ring *grow(ring *current, intptr_t top, intptr_t bottom) {
+                std::unique_ptr<ring> bigger(new ring((current->mask + 1) * 2));
+                for (auto i = top; i < bottom; ++i) {
+                    bigger->put(i, current->get(i));
+                }
+                rings_.push_back(std::move(bigger));
+                ring_.store(rings_.back().get(), std::memory_order_release);
+                return rings_.back().get();
+            }
+
+            // top and bottom on separate cache lines, without over-aligning
+            // the type
+            std::atomic<intptr_t> top_;
+            char top_padding_[64 - sizeof(std::atomic<intptr_t>)];
+            std::atomic<intptr_t> bottom_;
+            char bottom_padding_[64 - sizeof(std::atomic<intptr_t>)];
+            std::atomic<ring *> ring_;
+            std::vector<std::unique_ptr<ring>> rings_;
+        };
+
+        struct worker_binding {
+            task_scheduler::state *owner = nullptr;
+            size_t index = 0;
+        };
+
+        worker_binding &current_worker() {
+            static thread_local worker_binding binding;
+            return binding;
+        }
+
+    }
+
+    struct task_scheduler::state {
+        struct worker {
+            work_deque deque;
+            std::thread thread;
+        };
+
+        std::vector<std::unique_ptr<worker>> workers;
+
+        std::mutex injection_mtx;
+        std::deque<task *> injection;
+        std::atomic<size_t> injected{0};
+
+        // tasks sitting in deques or the injection queue
+        std::atomic<size_t> queued{0};
+        // submitted or scheduled tasks that have not finished yet
+        std::atomic<size_t> unfinished{0};
+
+        std::mutex sleep_mtx;
+        std::condition_variable sleep_cv;
+        std::atomic<size_t> sleepers{0};
+        bool stopping = false;
+
+        std::mutex idle_mtx;
+        std::condition_variable idle_cv;
+
+        void enqueue(task *item) {
+            auto &binding = current_worker();
+            if (binding.owner == this) {
+                workers[binding.index]->deque.push(item);
+            } else {
+                std::lock_guard<std::mutex> lock(injection_mtx);
+                injection.push_back(item);
+                injected.fetch_add(1, std::memory_order_relaxed);
+            }
+            queued.fetch_add(1, std::memory_order_seq_cst);
+            if (sleepers.load(std::memory_order_seq_cst) != 0) {
+                std::lock_guard<std::mutex> lock(sleep_mtx);
+                sleep_cv.notify_one();
+            }
+        }
+
+        task *find_task(size_t index) {
+            auto item = workers[index]->deque.take();
+            if (!item && injected.load(std::memory_order_relaxed) != 0) {
+                std::lock_guard<std::mutex> lock(injection_mtx);
+                if (!injection.empty()) {
+                    item = injection.front();
+                    injection.pop_front();
+                    injected.fetch_sub(1, std::memory_order_relaxed);
+                }
+            }
+            for (size_t i = 1; !item && i < workers.size(); ++i) {
+                item = workers[(index + i) % workers.size()]->deque.steal();
+            }
+            if (item) {
+                queued.fetch_sub(1, std::memory_order_relaxed);
+            }
+            return item;
+        }
+
+        void run(task *item) {
+            item->execute();
+            if (auto next = item->continuation_.detach()) {
+                if (next->predecessors_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    // the ref we just detached moves on to the scheduler
+                    unfinished.fetch_add(1, std::memory_order_relaxed);
+                    enqueue(next);
+                } else {
+                    intrusive_ptr_release(next);
+                }
+            }
+            intrusive_ptr_release(item);
+            if (unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lock(idle_mtx);
+                idle_cv.notify_all();
+            }
+        }
+
+        void work(size_t index) {
+            auto &binding = current_worker();
+            binding.owner = this;
+            binding.index = index;
+            for (;;) {
+                task *item = nullptr;
+                for (int spin = 0; !item && spin < 64; ++spin) {
+                    item = find_task(index);
+                    if (!item) {
+                        std::this_thread::yield();
+                    }
+                }
+                if (item) {
+                    run(item);
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(sleep_mtx);
+                sleepers.fetch_add(1, std::memory_order_seq_cst);
+                while (!stopping && queued.load(std::memory_order_seq_cst) == 0) {
+                    sleep_cv.wait(lock);
+                }
+                sleepers.fetch_sub(1, std::memory_order_relaxed);
+                if (stopping && queued.load(std::memory_order_relaxed) == 0) {
+                    break;
+                }
+            }
+            binding = worker_binding();
+        }
+    };
+
+    task_scheduler::task_scheduler(size_t workers) : state_(new state) {
+        auto count = workers ? workers : 1;
+        for (size_t i = 0; i < count; ++i) {
+            state_->workers.emplace_back(new state::worker);
+        }
+        auto worker_state = state_;
+        for (size_t i = 0; i < count; ++i) {
+            state_->workers[i]->thread = std::thread([worker_state, i] { worker_state->work(i); });
+        }
+    }
+
+    task_scheduler::~task_scheduler() {
+        wait_idle();
+        {
+            std::lock_guard<std::mutex> lock(state_->sleep_mtx);
+            state_->stopping = true;
+        }
+        state_->sleep_cv.notify_all();
+        for (auto &worker : state_->workers) {
+            worker->thread.join();
+        }
+        delete state_;
+    }
+
+    void task_scheduler::submit(intrusive_ptr<task> &&ptr) {
+        if (auto item = ptr.detach()) {
+            state_->unfinished.fetch_add(1, std::memory_order_relaxed);
+            state_->enqueue(item);
+        }
+    }
+
+    void task_scheduler::wait_idle() {
+        std::unique_lock<std::mutex> lock(state_->idle_mtx);
+        state_->idle_cv.wait(lock, [this] { return state_->unfinished.load(std::memory_order_acquire) == 0; });
+    }
+
+    size_t task_scheduler::worker_count() const noexcept {
+        return state_->workers.size();
+    }
+
+} //
@@ -0,0 +1,119 @@
+#ifndef TASK_SCHEDULER_HPP
+#define TASK_SCHEDULER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "intrusive_ptr.hpp"
+#include "ref_counted.hpp"
+
+
+namespace std {
+
+    class task_scheduler;
+
+    // Unit of work for task_scheduler. The scheduler owns a submitted task
+    // through the ref that was moved into submit() and drops it after
+    // execute() returns.
+    //
+    // then() makes another task run once this one has finished. A task that
+    // several tasks then() to waits for all of them, so fan-in needs no
+    // extra counter object. Link tasks before submitting the first of their
+    // predecessors, and submit only tasks that wait on nothing; continuations
+    // are scheduled by the scheduler itself.
+    class task : public basic_ref_counted<atomic_ref_count, task> {
+    public:
+        virtual ~task();
+
+        task() noexcept;
+
+        task(const task &) = delete;
+
+        task &operator=(const task &) = delete;
+
+        // Runs next after this task; returns next for chaining. A task has at
+        // most one continuation, so then() may be called once per task.
+        const intrusive_ptr<task> &then(intrusive_ptr<task> next) noexcept;
+
+        // Number of tasks that still have to finish before this one may run.
+        inline size_t pending_predecessors() const noexcept {
+            return predecessors_.load(std::memory_order_acquire);
+        }
+
+    protected:
+        // Exceptions escaping execute() terminate the process.
+        virtual void execute() = 0;
+
+    private:
+        friend class task_scheduler;
+
+        intrusive_ptr<task> continuation_;
+        std::atomic<size_t> predecessors_;
+    };
+
+    namespace intrusive_detail {
+
+        template <class F>
+        class function_task final : public task {
+        public:
+            explicit function_task(F &&f) : f_(std::move(f)) {}
+
+            explicit function_task(const F &f) : f_(f) {}
+
+        protected:
+            void execute() override {
+                f_();
+            }
+
+        private:
+            F f_;
+        };
+
+    }
+
+    // Wraps a callable in a task; the callable is stored inline, so this is
+    // the only allocation for the task.
+    template <class F>
+    inline intrusive_ptr<task> make_task(F &&f) {
+        using function_type = typename decay<F>::type;
+        return intrusive_ptr<task>(new intrusive_detail::function_task<function_type>(std::forward<F>(f)), false);
+    }
+
+    // Work-stealing scheduler with one Chase-Lev deque per worker thread.
+    //
+    // Deques hold detached task pointers: submit() moves the caller's ref in,
+    // workers and thieves move the raw pointer out, and the ref is released
+    // once the task has run. Workers take their own newest task first and
+    // steal the oldest task of another worker when idle. Tasks submitted
+    // from outside the pool go through a shared injection queue.
+    class task_scheduler {
+    public:
+        explicit task_scheduler(size_t workers = std::thread::hardware_concurrency());
+
+        // Waits for every submitted task, then stops the workers.
+        ~task_scheduler();
+
+        task_scheduler(const task_scheduler &) = delete;
+
+        task_scheduler &operator=(const task_scheduler &) = delete;
+
+        void submit(intrusive_ptr<task> &&ptr);
+
+        // Blocks until every submitted task and its continuations finished.
+        // Must not be called from a task of this scheduler.
+        void wait_idle();
+
+        size_t worker_count() const noexcept;
+
+        struct state;
+
+    private:
+        state *state_;
+    };
+
+}
+
+#endif // TASK_SCHEDULER_HPP
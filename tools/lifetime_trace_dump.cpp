@@ -0,0 +1,148 @@
+// Rebuilds per-object ref histories from a drain_lifetime_trace() file.
+//
+//   lifetime_trace_dump trace.bin             summary and anomalies
+//   lifetime_trace_dump trace.bin 0x7f..40    full history of one object
+//
+// An object's history starts at its created event and ends when the count
+// returns to zero; a later created event at the same address starts a new
+// history. Reported anomalies:
+//   double release     a release takes the count below zero
+//   use after release  an add_ref or release after the count reached zero
+//   leaked             count still above zero at the end of the trace
+// Caller addresses are runtime addresses; subtract the load address of the
+// traced binary (see /proc/<pid>/maps) before resolving them with
+// addr2line.
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "../lifetime_trace.hpp"
+
+namespace {
+
+    struct object_state {
+        int64_t count = 0;
+        bool live = false;
+        bool seen_created = false;
+        uint64_t events = 0;
+    };
+
+    const char *kind_name(std::lifetime_event_kind kind) {
+        switch (kind) {
+            case std::lifetime_event_kind::created:
+                return "created";
+            case std::lifetime_event_kind::add_ref:
+                return "add_ref";
+            case std::lifetime_event_kind::release:
+                return "release";
+        }
+        return "unknown";
+    }
+
+    void print_event(const std::lifetime_event &event, int64_t count_after) {
+        std::printf("%20" PRIu64 "  thread %4" PRIu32 "  %-8s %6" PRIu32 "  -> %6" PRId64 "  caller 0x%" PRIx64 "\n",
+                    event.timestamp, event.thread, kind_name(event.kind()), event.count(), count_after,
+                    event.caller);
+    }
+
+    void report(const char *what, const std::lifetime_event &event, int64_t count_after) {
+        std::printf("%s: object 0x%" PRIx64 "\n  ", what, event.object);
+        print_event(event, count_after);
+    }
+
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s trace-file [object-address]\n", argv[0]);
+        return 2;
+    }
+    auto in = std::fopen(argv[1], "rb");
+    if (!in) {
+        std::perror(argv[1]);
+        return 1;
+    }
+    std::lifetime_trace_header header;
+    if (std::fread(&header, sizeof(header), 1, in) != 1 || std::memcmp(header.magic, "IPTRACE", 8) != 0 ||
+        header.version != 1 || header.event_size != sizeof(std::lifetime_event)) {
+        std::fprintf(stderr, "%s: not a version 1 lifetime trace\n", argv[1]);
+        return 1;
+    }
+    std::vector<std::lifetime_event> events;
+    std::lifetime_event event;
+    while (std::fread(&event, sizeof(event), 1, in) == 1) {
+        events.push_back(event);
+    }
+    std::fclose(in);
+
+    bool filter = argc > 2;
+    uint64_t selected = filter ? std::strtoull(argv[2], nullptr, 16) : 0;
+
+    // Drain order interleaves threads; the timestamp orders them. Events
+    // of one thread keep their relative order.
+    std::stable_sort(events.begin(), events.end(), [](const std::lifetime_event &a, const std::lifetime_event &b) {
+        return a.timestamp < b.timestamp;
+    });
+
+    std::map<uint64_t, object_state> objects;
+    uint64_t anomalies = 0;
+    for (auto &e : events) {
+        auto &state = objects[e.object];
+        ++state.events;
+        switch (e.kind()) {
+            case std::lifetime_event_kind::created:
+                if (state.live && state.count > 0 && !filter) {
+                    report("leaked (address reused)", e, state.count);
+                    ++anomalies;
+                }
+                state.count = e.count();
+                state.live = true;
+                state.seen_created = true;
+                break;
+            case std::lifetime_event_kind::add_ref:
+                if (!state.live && state.seen_created && !filter) {
+                    report("use after release", e, state.count + e.count());
+                    ++anomalies;
+                }
+                state.count += e.count();
+                break;
+            case std::lifetime_event_kind::release:
+                if (!state.live && state.seen_created && !filter) {
+                    report("use after release", e, state.count - e.count());
+                    ++anomalies;
+                }
+                state.count -= e.count();
+                if (state.count < 0 && !filter) {
+                    report("double release", e, state.count);
+                    ++anomalies;
+                }
+                if (state.count <= 0) {
+                    state.live = false;
+                }
+                break;
+        }
+        if (filter && e.object == selected) {
+            print_event(e, state.count);
+        }
+    }
+    if (filter) {
+        return 0;
+    }
+
+    uint64_t leaked = 0;
+    for (auto &entry : objects) {
+        if (entry.second.live && entry.second.count > 0) {
+            std::printf("leaked: object 0x%" PRIx64 " count %" PRId64 " after %" PRIu64 " events\n", entry.first,
+                        entry.second.count, entry.second.events);
+            ++leaked;
+        }
+    }
+    std::printf("%zu events, %zu objects, %" PRIu64 " anomalies, %" PRIu64 " leaked\n", events.size(),
+                objects.size(), anomalies, leaked);
+    return anomalies ? 1 : 0;
+}
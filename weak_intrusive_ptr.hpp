@@ -6,6 +6,7 @@
 #include <type_traits>
 
 #include "intrusive_ptr.hpp"
+#include "weak_ref_counted.hpp"
 
 
 namespace std {
@@ -29,6 +30,13 @@ namespace std {
             set_ptr(raw_ptr, add_ref);
         }
 
+        weak_intrusive_ptr(pointer raw_ptr, adopt_ref_t) noexcept : ptr_(raw_ptr) {
+        }
+
+        weak_intrusive_ptr(pointer raw_ptr, borrow_ref_t) noexcept {
+            set_ptr(raw_ptr, true);
+        }
+
         weak_intrusive_ptr(weak_intrusive_ptr&& other) noexcept
                 : ptr_(other.detach()) {
         }
@@ -38,11 +46,17 @@ namespace std {
         }
 
         template <class Y>
-        weak_intrusive_ptr(weak_intrusive_ptr<Y> other) noexcept
+        weak_intrusive_ptr(weak_intrusive_ptr<Y>&& other) noexcept
                 : ptr_(other.detach()) {
             static_assert(std::is_convertible<Y*, T*>::value, "Y* is not assignable to T*");
         }
 
+        template <class Y>
+        weak_intrusive_ptr(const weak_intrusive_ptr<Y>& other) noexcept {
+            static_assert(std::is_convertible<Y*, T*>::value, "Y* is not assignable to T*");
+            set_ptr(other.get(), true);
+        }
+
         ~weak_intrusive_ptr() {
             if (ptr_) {
                 intrusive_ptr_release_weak(ptr_);
@@ -64,7 +78,7 @@ namespace std {
             return detach();
         }
 
-        void reset(pointer new_value = nullptr, bool add_ref = true) {
+        void reset(pointer new_value = nullptr, bool add_ref = true) noexcept {
             auto old = ptr_;
             set_ptr(new_value, add_ref);
             if (old) {
@@ -77,8 +91,28 @@ namespace std {
             return *this;
         }
 
-        weak_intrusive_ptr& operator=(weak_intrusive_ptr other) noexcept {
-            swap(other);
+        weak_intrusive_ptr& operator=(const weak_intrusive_ptr& other) noexcept {
+            reset(other.get());
+            return *this;
+        }
+
+        // Takes over other's weak ref; only the old value is released.
+        weak_intrusive_ptr& operator=(weak_intrusive_ptr&& other) noexcept {
+            reset(other.detach(), false);
+            return *this;
+        }
+
+        template <class Y>
+        weak_intrusive_ptr& operator=(const weak_intrusive_ptr<Y>& other) noexcept {
+            static_assert(std::is_convertible<Y*, T*>::value, "Y* is not assignable to T*");
+            reset(other.get());
+            return *this;
+        }
+
+        template <class Y>
+        weak_intrusive_ptr& operator=(weak_intrusive_ptr<Y>&& other) noexcept {
+            static_assert(std::is_convertible<Y*, T*>::value, "Y* is not assignable to T*");
+            reset(other.detach(), false);
             return *this;
         }
 
@@ -108,7 +142,7 @@ namespace std {
                 return nullptr;
             }
 
-            return {ptr_, false};
+            return {ptr_, adopt_ref};
         }
 
 
@@ -130,6 +164,9 @@ namespace std {
         pointer ptr_;
     };
 
+    template <class T>
+    struct trivially_relocatable<weak_intrusive_ptr<T>> : true_type {};
+
     template <class X, typename Y>
     bool operator==(const weak_intrusive_ptr<X>& lhs, const weak_intrusive_ptr<Y>& rhs) {
         return lhs.get() == rhs.get();
@@ -0,0 +1,31 @@
+#include "weak_ref_counted.hpp"
+
+namespace std {
+
+    constexpr uint64_t weak_ref_counted::strong_one;
+    constexpr unsigned weak_ref_counted::weak_shift;
+    constexpr uint64_t weak_ref_counted::weak_one;
+    constexpr uint64_t weak_ref_counted::strong_mask;
+
+    weak_ref_counted::~weak_ref_counted() {
+        // nop
+    }
+
+    weak_ref_counted::weak_ref_counted() : rc_(strong_one | weak_one) {
+        // nop; one strong ref plus the weak ref shared by all strong refs
+    }
+
+    weak_ref_counted::weak_ref_counted(const weak_ref_counted &) : rc_(strong_one | weak_one) {
+        // nop; don't copy reference counts
+    }
+
+    weak_ref_counted &weak_ref_counted::operator=(const weak_ref_counted &) {
+        // nop; intentionally don't copy reference counts
+        return *this;
+    }
+
+    void weak_ref_counted::dispose() noexcept {
+        // nop
+    }
+
+} //
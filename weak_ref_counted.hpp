@@ -0,0 +1,123 @@
+#ifndef WEAK_REF_COUNTED_HPP
+#define WEAK_REF_COUNTED_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "ref_counted.hpp"
+
+
+namespace std {
+
+    // Strong and weak counts share one 64-bit word: the low half counts
+    // strong refs, the high half counts weak refs. All strong refs together
+    // hold one weak ref, so the storage lives until both halves reach zero.
+    class weak_ref_counted {
+    public:
+        virtual ~weak_ref_counted();
+
+        weak_ref_counted();
+
+        weak_ref_counted(const weak_ref_counted &);
+
+        weak_ref_counted &operator=(const weak_ref_counted &);
+
+        inline void ref(size_t n = 1) noexcept {
+            rc_.fetch_add(n * strong_one, std::memory_order_relaxed);
+        }
+
+        inline void deref(size_t n = 1) noexcept {
+            if ((rc_.fetch_sub(n * strong_one, std::memory_order_release) & strong_mask) == n) {
+                intrusive_detail::acquire_last_release(rc_);
+                dispose();
+                weak_deref();
+            }
+        }
+
+        inline void weak_ref() noexcept {
+            rc_.fetch_add(weak_one, std::memory_order_relaxed);
+        }
+
+        inline void weak_deref() noexcept {
+            if (rc_.fetch_sub(weak_one, std::memory_order_release) == weak_one) {
+                intrusive_detail::acquire_last_release(rc_);
+                delete this;
+            }
+        }
+
+        // Acquires a strong ref unless the object has already expired.
+        inline bool upgrade() noexcept {
+            auto value = rc_.load(std::memory_order_relaxed);
+            do {
+                if ((value & strong_mask) == 0) {
+                    return false;
+                }
+            } while (!rc_.compare_exchange_weak(value, value + strong_one,
+                                                std::memory_order_acquire,
+                                                std::memory_order_relaxed));
+            return true;
+        }
+
+        inline bool unique() const noexcept {
+            return get_reference_count() == 1;
+        }
+
+        inline bool expired() const noexcept {
+            return get_reference_count() == 0;
+        }
+
+        inline size_t get_reference_count() const noexcept {
+            return static_cast<size_t>(rc_.load(std::memory_order_acquire) & strong_mask);
+        }
+
+        inline size_t get_weak_reference_count() const noexcept {
+            return static_cast<size_t>(rc_.load(std::memory_order_acquire) >> weak_shift);
+        }
+
+    protected:
+        // Called once when the last strong ref goes away. The storage stays
+        // valid until the last weak ref is dropped, so this is the place to
+        // release resources and outgoing refs that weak holders must not keep
+        // alive. The destructor runs only after the last weak ref is gone.
+        virtual void dispose() noexcept;
+
+        static constexpr uint64_t strong_one = 1;
+        static constexpr unsigned weak_shift = 32;
+        static constexpr uint64_t weak_one = uint64_t{1} << weak_shift;
+        static constexpr uint64_t strong_mask = weak_one - 1;
+
+        std::atomic<uint64_t> rc_;
+    };
+
+    inline void intrusive_ptr_add_ref(weak_ref_counted *p) {
+        p->ref();
+    }
+
+    inline void intrusive_ptr_release(weak_ref_counted *p) {
+        p->deref();
+    }
+
+    inline void intrusive_ptr_add_ref(weak_ref_counted *p, size_t n) {
+        p->ref(n);
+    }
+
+    inline void intrusive_ptr_release(weak_ref_counted *p, size_t n) {
+        p->deref(n);
+    }
+
+    inline void intrusive_ptr_add_weak_ref(weak_ref_counted *p) {
+        p->weak_ref();
+    }
+
+    inline void intrusive_ptr_release_weak(weak_ref_counted *p) {
+        p->weak_deref();
+    }
+
+    inline bool intrusive_ptr_upgrade_weak(weak_ref_counted *p) {
+        return p->upgrade();
+    }
+
+}
+
+#endif // WEAK_REF_COUNTED_HPP